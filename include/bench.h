@@ -17,8 +17,13 @@
 #ifndef BENCH_H
 #define BENCH_H
 
+#include <stddef.h>
+
 #include "transposition.h"
 
-void bench(struct transpositiontable *tt);
+extern const char *bench_fens[];
+extern const size_t bench_fens_num;
+
+int bench(int argc, char **argv, struct transpositiontable *tt);
 
 #endif
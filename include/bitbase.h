@@ -17,6 +17,11 @@
 #ifndef BITBASE_H
 #define BITBASE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "position.h"
+
 enum {
 	BITBASE_DRAW    = 0,
 	BITBASE_WIN     = 1,
@@ -29,6 +34,74 @@ static inline unsigned orient_bitbase_eval(int orient, unsigned p) {
 	return orient ? ((p & 1) << 1) | ((p & 2) >> 1) : p;
 }
 
+/* Bitbases of any material with at most BITBASE_PIECES_MAX pieces besides the
+ * kings, generated by basebit and loaded at runtime. The first side of the
+ * name, i.e. KRP in KRPKR, is white in the table and every evaluation is from
+ * its point of view. Positions are indexed by the side to move, the white king
+ * mirrored to the files a-d, the black king and then the remaining pieces of
+ * both sides in order of decreasing value. Pawns only have the 48 squares on
+ * rank 2 to 7 and identical pieces are stored in increasing square order.
+ */
+#define BITBASE_PIECES_MAX 3
+
+/* The most bitbases that basebit and the engine load at once. */
+#define BITBASES_MAX 256
+
+struct bitbase {
+	char name[16];
+	int pieces_num[2];
+	int pieces[2][BITBASE_PIECES_MAX];
+	uint32_t material[2];
+	long size;
+
+	const uint32_t *table;
+	void *map;
+	size_t map_size;
+};
+
+int bitbase_parse(struct bitbase *bb, const char *name);
+
+int bitbase_side(const struct bitbase *bb, const struct position *pos);
+
+long bitbase_index_by_square(const struct bitbase *bb, int turn, int squares[2][BITBASE_PIECES_MAX + 1]);
+long bitbase_index(const struct bitbase *bb, const struct position *pos, int white_side);
+void bitbase_squares(const struct bitbase *bb, long index, int *turn, int squares[2][BITBASE_PIECES_MAX + 1]);
+
+static inline unsigned bitbase_probe_by_index(const struct bitbase *bb, long index) {
+	return (bb->table[index / 16] >> (2 * (index % 16))) & 0x3;
+}
+
+static inline unsigned bitbase_probe(const struct bitbase *bb, const struct position *pos, int eval_side) {
+	int white_side = bitbase_side(bb, pos);
+	unsigned p     = bitbase_probe_by_index(bb, bitbase_index(bb, pos, white_side));
+	return orient_bitbase_eval(white_side != eval_side, p);
+}
+
+int bitbase_load(struct bitbase *bb, const char *path);
+void bitbase_unload(struct bitbase *bb);
+int bitbase_save(const struct bitbase *bb, const uint32_t *table, const char *path);
+
+/* The builtin bitbases KPK, KPKP and KRKP are compressed into runs of equal
+ * evaluations, one byte per run with the evaluation in the upper 2 bits and
+ * the length minus one in the lower 6 bits. Invalid positions are merged into
+ * a neighbouring run. Runs never cross a block of BITBASE_BLOCK_SIZE positions
+ * and the table starts with the byte offset of the first run of every block,
+ * followed by the runs packed 4 to an entry.
+ */
+#define BITBASE_BLOCK_SIZE 512
+#define BITBASE_RUN_LENGTH 64
+
+static inline unsigned bitbase_compressed_probe(const uint32_t *table, long blocks, long index) {
+	const uint32_t *runs = table + blocks;
+	long offset          = table[index / BITBASE_BLOCK_SIZE];
+	long i               = index % BITBASE_BLOCK_SIZE;
+	for (;; offset++) {
+		unsigned run = (runs[offset / 4] >> (8 * (offset % 4))) & 0xFF;
+		if ((i -= (run & 0x3F) + 1) < 0)
+			return run >> 6;
+	}
+}
+
 #include "kpk.h"
 #include "kpkp.h"
 #include "krkp.h"
@@ -30,14 +30,18 @@
 extern int endgame_init_done;
 #endif
 
-#define ENDGAMEBITS  (9)
+#define ENDGAMEBITS  (10)
 #define ENDGAMESIZE  (1 << ENDGAMEBITS)
 #define ENDGAMEINDEX (ENDGAMESIZE - 1)
 
+struct bitbase;
+
 struct endgame {
 	uint64_t endgame_key;
 	int32_t (*evaluate)(const struct position *pos, int strong_side);
 	uint8_t strong_side;
+	/* Set if the endgame is evaluated by a loaded bitbase. */
+	const struct bitbase *bitbase;
 };
 
 extern struct endgame endgame_table[ENDGAMESIZE];
@@ -45,8 +49,15 @@ extern struct endgame endgame_KXK[2];
 
 int is_KXK(const struct position *pos, int color);
 
+/* The table is probed linearly from the index of the key, so endgames whose
+ * keys share an index are all stored. Returns the entry of the endgame of pos,
+ * or the empty entry where it would be stored. The table is never full.
+ */
 static inline struct endgame *endgame_get(const struct position *pos) {
-	return &endgame_table[pos->endgame_key & ENDGAMEINDEX];
+	uint64_t i = pos->endgame_key & ENDGAMEINDEX;
+	while (endgame_table[i].evaluate && endgame_table[i].endgame_key != pos->endgame_key)
+		i = (i + 1) & ENDGAMEINDEX;
+	return &endgame_table[i];
 }
 
 static inline struct endgame *endgame_probe(const struct position *pos) {
@@ -56,7 +67,7 @@ static inline struct endgame *endgame_probe(const struct position *pos) {
 	assert(endgame_init_done);
 
 	struct endgame *e = endgame_get(pos);
-	if (e->endgame_key == pos->endgame_key)
+	if (e->evaluate)
 		return e;
 
 	/* Check if pos qualifies for KXK. */
@@ -67,6 +78,19 @@ static inline struct endgame *endgame_probe(const struct position *pos) {
 	return NULL;
 }
 
+static inline struct endgame *material_probe(struct material *material_table, const struct position *pos) {
+	if (!option_endgame)
+		return NULL;
+
+	struct material *m = &material_table[pos->endgame_key & MATERIALINDEX];
+	if (m->endgame_key != pos->endgame_key) {
+		m->endgame_key = pos->endgame_key;
+		m->endgame     = endgame_probe(pos);
+	}
+
+	return m->endgame;
+}
+
 /* If pos->halfmove is too large we should probably return 0
  * because we don't have enough time to force a checkmate.
  */
@@ -80,6 +104,8 @@ void refresh_endgame_key(struct position *pos);
 void do_endgame_key(struct position *pos, const move_t *move);
 void undo_endgame_key(struct position *pos, const move_t *move);
 
+void endgame_bitbases(const char *path);
+
 void endgame_init(void);
 
 #endif
@@ -38,6 +38,21 @@ extern const int material_value[7];
 #define PHASE        (256)
 #define NORMAL_SCALE (256)
 
+#define MATERIALBITS  (12)
+#define MATERIALSIZE  (1 << MATERIALBITS)
+#define MATERIALINDEX (MATERIALSIZE - 1)
+
+struct endgame;
+
+/* The result of endgame_probe only depends on the material, so we cache
+ * it by endgame_key. An entry with a matching key and endgame set to
+ * NULL means that there is no endgame for this material.
+ */
+struct material {
+	uint64_t endgame_key;
+	struct endgame *endgame;
+};
+
 struct evaluationinfo {
 	uint64_t mobility[2];
 	uint64_t pawn_attack_span[2];
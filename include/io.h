@@ -35,6 +35,22 @@ enum {
 	FLAG_SKIP = 0x1,
 };
 
+/* Files of version 2 start with a header of BIT_HEADER_SIZE bytes, the magic
+ * followed by a null byte and the version. Files of version 1 have no header
+ * and always start with a zero move. Both versions are a sequence of records
+ * of a move, an eval and a flag, where every zero move is followed by the
+ * starting position and result of a new game. Version 2 stores positions as an
+ * occupancy bitboard followed by the pieces of the occupied squares packed two
+ * per byte, and the eval as a variable length integer.
+ */
+#define BIT_MAGIC       "bitbit"
+#define BIT_VERSION     2
+#define BIT_HEADER_SIZE 8
+
+int write_header(FILE *f, int version);
+int read_header(FILE *f, int *version);
+int read_header_mem(const unsigned char *data, int *version, size_t *index, size_t size);
+
 int write_uintx(FILE *f, uint64_t p, size_t x);
 int read_uintx(FILE *f, void *p, size_t x);
 
@@ -42,6 +58,10 @@ int write_position(FILE *f, const struct position *pos);
 int read_position(FILE *f, struct position *pos);
 int read_position_mem(const unsigned char *data, struct position *pos, size_t *index, size_t size);
 
+int write_position2(FILE *f, const struct position *pos);
+int read_position2(FILE *f, struct position *pos);
+int read_position2_mem(const unsigned char *data, struct position *pos, size_t *index, size_t size);
+
 int write_move(FILE *f, move_t move);
 int read_move(FILE *f, move_t *move);
 int read_move_mem(const unsigned char *data, move_t *move, size_t *index, size_t size);
@@ -50,6 +70,10 @@ int write_eval(FILE *f, int32_t eval);
 int read_eval(FILE *f, int32_t *eval);
 int read_eval_mem(const unsigned char *data, int32_t *eval, size_t *index, size_t size);
 
+int write_eval2(FILE *f, int32_t eval);
+int read_eval2(FILE *f, int32_t *eval);
+int read_eval2_mem(const unsigned char *data, int32_t *eval, size_t *index, size_t size);
+
 int write_result(FILE *f, signed char result);
 int read_result(FILE *f, signed char *result);
 int read_result_mem(const unsigned char *data, signed char *result, size_t *index, size_t size);
@@ -58,4 +82,51 @@ int write_flag(FILE *f, unsigned char flag);
 int read_flag(FILE *f, unsigned char *flag);
 int read_flag_mem(const unsigned char *data, unsigned char *flag, size_t *index, size_t size);
 
+/* The offset, number of positions and result of every game of a .bit file,
+ * stored next to it in a sidecar file with the suffix .idx. The sidecar starts
+ * with BITINDEX_MAGIC, the size, version, inode and modification time of the
+ * .bit file and the number of games, followed by 13 bytes per game. A sidecar
+ * is stale and never loaded if the .bit file has been replaced or modified, or
+ * if any offset is not the start of a game.
+ */
+#define BITINDEX_MAGIC "bitidx2"
+
+struct bitindex {
+	uint64_t size;
+	int version;
+
+	size_t games_num;
+	uint64_t *offsets;
+	uint32_t *plies;
+	signed char *results;
+};
+
+/* Encodes whole games into memory and writes them in chunks of
+ * BITWRITER_CHUNK bytes, with a single write per chunk.
+ */
+#define BITWRITER_CHUNK (1 << 20)
+
+struct bitwriter {
+	FILE *f;
+	int version;
+	int error;
+
+	unsigned char *buf;
+	size_t len;
+	size_t capacity;
+
+	uint64_t size;
+	size_t games;
+};
+
+int bitwriter_open(struct bitwriter *w, const char *path, int version);
+int bitwriter_game(struct bitwriter *w, const struct position *start, signed char result, int ply,
+                   const move_t *moves, const int32_t *evals, const unsigned char *flags);
+int bitwriter_close(struct bitwriter *w);
+
+int bitindex_build_mem(struct bitindex *bi, const unsigned char *data, size_t size);
+int bitindex_save(const struct bitindex *bi, const char *path);
+int bitindex_load(struct bitindex *bi, const char *path, const unsigned char *data, uint64_t size);
+void bitindex_free(struct bitindex *bi);
+
 #endif
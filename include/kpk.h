@@ -21,14 +21,14 @@
 #include "bitboard.h"
 #include "position.h"
 
-#define BITBASE_KPK_INDEX_MAX           (2 * 64 * 24 * 64)
-#define BITBASE_KPK_BITS_PER_POSITION   (2)
-#define BITBASE_KPK_BITS_MASK           ((1 << BITBASE_KPK_BITS_PER_POSITION) - 1)
-#define BITBASE_KPK_BITS_PER_ENTRY      (8 * sizeof(*bitbase_KPK))
-#define BITBASE_KPK_POSITIONS_PER_ENTRY (BITBASE_KPK_BITS_PER_ENTRY / BITBASE_KPK_BITS_PER_POSITION)
-#define BITBASE_KPK_TABLE_SIZE          (BITBASE_KPK_INDEX_MAX * BITBASE_KPK_BITS_PER_POSITION / BITBASE_KPK_BITS_PER_ENTRY)
+#define BITBASE_KPK_INDEX_MAX (2 * 64 * 24 * 64)
+#define BITBASE_KPK_BLOCKS    (BITBASE_KPK_INDEX_MAX / BITBASE_BLOCK_SIZE)
+/* The entries of runs in etc/kpk.bin, as printed by basebit when the table is
+ * regenerated. A table that does not match fails to compile.
+ */
+#define BITBASE_KPK_RUN_ENTRIES 3192
 
-extern uint32_t bitbase_KPK[];
+extern const uint32_t bitbase_KPK[];
 
 static inline long bitbase_KPK_index_by_square(int turn, int king_white, int pawn_white, int king_black) {
 	int orient = file_of(pawn_white) > 3;
@@ -37,9 +37,9 @@ static inline long bitbase_KPK_index_by_square(int turn, int king_white, int paw
 	king_black = orient_vertical(orient, king_black);
 	/* clang-format off */
 	return 64 * 24 * 64 * turn
-		  + 24 * 64 * king_white
+		  + 24 * 64 * king_black
 		       + 64 * (file_of(pawn_white) + (rank_of(pawn_white) - 1) * 4)
-		            + king_black;
+		            + king_white;
 	/* clang-format on */
 }
 
@@ -54,9 +54,7 @@ static inline long bitbase_KPK_index(const struct position *pos) {
 }
 
 static inline unsigned bitbase_KPK_probe_by_index(long index) {
-	long lookup_index = index / BITBASE_KPK_POSITIONS_PER_ENTRY;
-	long bit_index    = BITBASE_KPK_BITS_PER_POSITION * (index % BITBASE_KPK_POSITIONS_PER_ENTRY);
-	return (bitbase_KPK[lookup_index] >> bit_index) & BITBASE_KPK_BITS_MASK;
+	return bitbase_compressed_probe(bitbase_KPK, BITBASE_KPK_BLOCKS, index);
 }
 
 static inline unsigned bitbase_KPK_probe(const struct position *pos, int eval_side) {
@@ -71,15 +69,4 @@ static inline unsigned bitbase_KPK_probe_by_square(int turn, int king_white, int
 	return p;
 }
 
-static inline void bitbase_KPK_store_by_index(long index, unsigned eval) {
-	long lookup_index          = index / BITBASE_KPK_POSITIONS_PER_ENTRY;
-	long bit_index             = BITBASE_KPK_BITS_PER_POSITION * (index % BITBASE_KPK_POSITIONS_PER_ENTRY);
-	bitbase_KPK[lookup_index] &= ~(BITBASE_KPK_BITS_MASK << bit_index);
-	bitbase_KPK[lookup_index] |= (eval << bit_index);
-}
-
-static inline void bitbase_KPK_store(const struct position *pos, unsigned eval) {
-	bitbase_KPK_store_by_index(bitbase_KPK_index(pos), eval);
-}
-
 #endif
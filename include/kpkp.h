@@ -21,14 +21,14 @@
 #include "bitboard.h"
 #include "position.h"
 
-#define BITBASE_KPKP_INDEX_MAX           (64 * 24 * 64 * 48)
-#define BITBASE_KPKP_BITS_PER_POSITION   (2)
-#define BITBASE_KPKP_BITS_MASK           ((1 << BITBASE_KPKP_BITS_PER_POSITION) - 1)
-#define BITBASE_KPKP_BITS_PER_ENTRY      (8 * sizeof(*bitbase_KPKP))
-#define BITBASE_KPKP_POSITIONS_PER_ENTRY (BITBASE_KPKP_BITS_PER_ENTRY / BITBASE_KPKP_BITS_PER_POSITION)
-#define BITBASE_KPKP_TABLE_SIZE          (BITBASE_KPKP_INDEX_MAX * BITBASE_KPKP_BITS_PER_POSITION / BITBASE_KPKP_BITS_PER_ENTRY)
+#define BITBASE_KPKP_INDEX_MAX (64 * 24 * 64 * 48)
+#define BITBASE_KPKP_BLOCKS    (BITBASE_KPKP_INDEX_MAX / BITBASE_BLOCK_SIZE)
+/* The entries of runs in etc/kpkp.bin, as printed by basebit when the table is
+ * regenerated. A table that does not match fails to compile.
+ */
+#define BITBASE_KPKP_RUN_ENTRIES 139212
 
-extern uint32_t bitbase_KPKP[];
+extern const uint32_t bitbase_KPKP[];
 
 static inline long bitbase_KPKP_index_by_square(int king_white, int pawn_white, int king_black, int pawn_black) {
 	int orient = file_of(pawn_white) > 3;
@@ -37,10 +37,10 @@ static inline long bitbase_KPKP_index_by_square(int king_white, int pawn_white,
 	king_black = orient_vertical(orient, king_black);
 	pawn_black = orient_vertical(orient, pawn_black);
 	/* clang-format off */
-	return 24 * 64 * 48 * king_white
-		  + 64 * 48 * (file_of(pawn_white) + (rank_of(pawn_white) - 1) * 4)
-		       + 48 * king_black
-			    + (pawn_black - 8);
+	return 24 * 64 * 64 * (pawn_black - 8)
+		  + 64 * 64 * (file_of(pawn_white) + (rank_of(pawn_white) - 1) * 4)
+		       + 64 * king_black
+		            + king_white;
 	/* clang-format on */
 }
 
@@ -54,9 +54,7 @@ static inline long bitbase_KPKP_index(const struct position *pos) {
 }
 
 static inline unsigned bitbase_KPKP_probe_by_index(long index) {
-	long lookup_index = index / BITBASE_KPKP_POSITIONS_PER_ENTRY;
-	long bit_index    = BITBASE_KPKP_BITS_PER_POSITION * (index % BITBASE_KPKP_POSITIONS_PER_ENTRY);
-	return (bitbase_KPKP[lookup_index] >> bit_index) & BITBASE_KPKP_BITS_MASK;
+	return bitbase_compressed_probe(bitbase_KPKP, BITBASE_KPKP_BLOCKS, index);
 }
 
 static inline unsigned bitbase_KPKP_probe(const struct position *pos, int eval_side) {
@@ -65,15 +63,4 @@ static inline unsigned bitbase_KPKP_probe(const struct position *pos, int eval_s
 	return orient_bitbase_eval(white_side != eval_side, p);
 }
 
-static inline void bitbase_KPKP_store_by_index(long index, unsigned eval) {
-	long lookup_index           = index / BITBASE_KPKP_POSITIONS_PER_ENTRY;
-	long bit_index              = BITBASE_KPKP_BITS_PER_POSITION * (index % BITBASE_KPKP_POSITIONS_PER_ENTRY);
-	bitbase_KPKP[lookup_index] &= ~(BITBASE_KPKP_BITS_MASK << bit_index);
-	bitbase_KPKP[lookup_index] |= (eval << bit_index);
-}
-
-static inline void bitbase_KPKP_store(const struct position *pos, unsigned eval) {
-	bitbase_KPKP_store_by_index(bitbase_KPKP_index(pos), eval);
-}
-
 #endif
@@ -21,14 +21,14 @@
 #include "bitboard.h"
 #include "position.h"
 
-#define BITBASE_KRKP_INDEX_MAX           (2 * 64 * 64 * 64 * 24)
-#define BITBASE_KRKP_BITS_PER_POSITION   (2)
-#define BITBASE_KRKP_BITS_MASK           ((1 << BITBASE_KRKP_BITS_PER_POSITION) - 1)
-#define BITBASE_KRKP_BITS_PER_ENTRY      (8 * sizeof(*bitbase_KRKP))
-#define BITBASE_KRKP_POSITIONS_PER_ENTRY (BITBASE_KRKP_BITS_PER_ENTRY / BITBASE_KRKP_BITS_PER_POSITION)
-#define BITBASE_KRKP_TABLE_SIZE          (BITBASE_KRKP_INDEX_MAX * BITBASE_KRKP_BITS_PER_POSITION / BITBASE_KRKP_BITS_PER_ENTRY)
+#define BITBASE_KRKP_INDEX_MAX (2 * 64 * 64 * 64 * 24)
+#define BITBASE_KRKP_BLOCKS    (BITBASE_KRKP_INDEX_MAX / BITBASE_BLOCK_SIZE)
+/* The entries of runs in etc/krkp.bin, as printed by basebit when the table is
+ * regenerated. A table that does not match fails to compile.
+ */
+#define BITBASE_KRKP_RUN_ENTRIES 49152
 
-extern uint32_t bitbase_KRKP[];
+extern const uint32_t bitbase_KRKP[];
 
 static inline long bitbase_KRKP_index_by_square(int turn, int king_white, int rook_white, int king_black,
                                                 int pawn_black) {
@@ -38,11 +38,11 @@ static inline long bitbase_KRKP_index_by_square(int turn, int king_white, int ro
 	king_black = orient_vertical(orient, king_black);
 	pawn_black = orient_vertical(orient, pawn_black);
 	/* clang-format off */
-	return 64 * 64 * 64 * 24 * turn
-		  + 64 * 64 * 24 * king_white
-		       + 64 * 24 * rook_white
-		            + 24 * king_black
-			         + (file_of(pawn_black) + (rank_of(pawn_black) - 1) * 4);
+	return 24 * 64 * 64 * 64 * turn
+		  + 64 * 64 * 64 * (file_of(pawn_black) + (rank_of(pawn_black) - 1) * 4)
+		       + 64 * 64 * rook_white
+		            + 64 * king_black
+			         + king_white;
 	/* clang-format on */
 }
 
@@ -58,9 +58,7 @@ static inline long bitbase_KRKP_index(const struct position *pos) {
 }
 
 static inline unsigned bitbase_KRKP_probe_by_index(long index) {
-	long lookup_index = index / BITBASE_KRKP_POSITIONS_PER_ENTRY;
-	long bit_index    = BITBASE_KRKP_BITS_PER_POSITION * (index % BITBASE_KRKP_POSITIONS_PER_ENTRY);
-	return (bitbase_KRKP[lookup_index] >> bit_index) & BITBASE_KRKP_BITS_MASK;
+	return bitbase_compressed_probe(bitbase_KRKP, BITBASE_KRKP_BLOCKS, index);
 }
 
 static inline unsigned bitbase_KRKP_probe(const struct position *pos, int eval_side) {
@@ -69,15 +67,4 @@ static inline unsigned bitbase_KRKP_probe(const struct position *pos, int eval_s
 	return orient_bitbase_eval(white_side != eval_side, p);
 }
 
-static inline void bitbase_KRKP_store_by_index(long index, unsigned eval) {
-	long lookup_index           = index / BITBASE_KRKP_POSITIONS_PER_ENTRY;
-	long bit_index              = BITBASE_KRKP_BITS_PER_POSITION * (index % BITBASE_KRKP_POSITIONS_PER_ENTRY);
-	bitbase_KRKP[lookup_index] &= ~(BITBASE_KRKP_BITS_MASK << bit_index);
-	bitbase_KRKP[lookup_index] |= (eval << bit_index);
-}
-
-static inline void bitbase_KRKP_store(const struct position *pos, unsigned eval) {
-	bitbase_KRKP_store_by_index(bitbase_KRKP_index(pos), eval);
-}
-
 #endif
@@ -62,4 +62,9 @@ static inline uint64_t rook_attacks_pre(int square, uint64_t b) {
 uint64_t bishop_full_mask_calc(int square);
 uint64_t rook_full_mask_calc(int square);
 
+uint64_t bishop_attacks_calc(int square, uint64_t b);
+uint64_t rook_attacks_calc(int square, uint64_t b);
+
+uint64_t magic_find(int square, int piece);
+
 #endif
@@ -79,6 +79,7 @@ void print_move(const move_t *move);
 char *move_str_pgn(char *str, const struct position *pos, const move_t *move);
 char *move_str_algebraic(char *str, const move_t *move);
 
+move_t san_to_move(const struct position *pos, const char *str);
 move_t string_to_move(const struct position *pos, const char *str);
 
 void do_null_move(struct position *pos, int en_passant);
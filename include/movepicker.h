@@ -59,6 +59,9 @@ struct movepicker {
 	move_t counter_move;
 	const struct searchinfo *si;
 	const struct searchstack *ss;
+#ifdef STATS
+	struct searchstats *stats;
+#endif
 };
 
 move_t next_move(struct movepicker *mp);
@@ -48,15 +48,22 @@ struct position {
 	alignas(32) int32_t psqtaccumulation[2][PSQT_BUCKETS];
 };
 
+/* The first members are set by pstate_init_core and are enough for
+ * legal. The remaining members are set by pstate_init_extras and are
+ * needed by movegen, pseudo_legal and the movepicker. Since many nodes
+ * are pruned before a single move is generated we only compute the
+ * extras when they are needed.
+ */
 struct pstate {
 	uint64_t checkers;
-	uint64_t attacked[7];
 	/* Set if checkers contains exactly one bit.
 	 * checkray = between(ctz(checkers), king_square) | checkers;
 	 * If checkers is not exactly one bit it is set to 0.
 	 */
 	uint64_t checkray;
 	uint64_t pinned;
+
+	uint64_t attacked[7];
 	uint64_t check_threats[7];
 };
 
@@ -94,6 +101,8 @@ enum colored_piece {
 };
 
 void pstate_init(const struct position *pos, struct pstate *pstate);
+void pstate_init_core(const struct position *pos, struct pstate *pstate);
+void pstate_init_extras(const struct position *pos, struct pstate *pstate);
 
 /* Returns all pieces which attack king of color <color>. */
 uint64_t generate_checkers(const struct position *pos, int color);
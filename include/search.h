@@ -23,6 +23,7 @@
 #include "interface.h"
 #include "move.h"
 #include "position.h"
+#include "stats.h"
 #include "transposition.h"
 
 extern atomic_int ucistop;
@@ -52,6 +53,8 @@ struct searchinfo {
 	int16_t pawn_correction[2][65536];
 	int16_t non_pawn_correction[2][2][65536];
 
+	struct material material_table[MATERIALSIZE];
+
 	struct transpositiontable *tt;
 	struct history *history;
 
@@ -62,6 +65,10 @@ struct searchinfo {
 	struct timeinfo *ti;
 
 	uint64_t seed;
+
+#ifdef STATS
+	struct searchstats stats;
+#endif
 };
 
 int32_t negamax(struct position *pos, int depth, int ply, int32_t alpha, int32_t beta, int cut_node,
@@ -0,0 +1,66 @@
+/* bitbit, a bitboard based chess engine written in c.
+ * Copyright (C) 2022-2025 Isak Ellmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include "evaluate.h"
+
+/* Search statistics are only collected when compiled with -DSTATS,
+ * i.e. make STATS=yes. Otherwise STAT(x) expands to nothing and the
+ * search is left untouched.
+ */
+#ifdef STATS
+#define STAT(x) (x)
+#else
+#define STAT(x)
+#endif
+
+#define STATS_CUTOFF_INDICES 8
+
+enum {
+	STATS_MAIN,
+	STATS_QUIESCENCE,
+};
+
+struct searchstats {
+	uint64_t nodes[2];
+
+	/* Indexed by bound, index 0 counts misses. */
+	uint64_t tt_probes[2][4];
+	uint64_t tt_cutoffs[2];
+
+	/* The last index counts all later moves. */
+	uint64_t cutoffs[STATS_CUTOFF_INDICES];
+
+	uint64_t razor_tries, razor_cutoffs;
+	uint64_t futility_tries, futility_cutoffs;
+	uint64_t null_tries, null_cutoffs;
+	uint64_t lmr_searches, lmr_researches;
+	uint64_t singular_searches, singular_extensions, singular_multicuts;
+
+	/* Eval comparisons of sort_moves and pick_next, and the comparisons
+	 * sort_moves would have needed to sort all quiet moves instead.
+	 */
+	uint64_t sort_comparisons, pick_comparisons, quiet_sort_comparisons;
+
+	/* Total number of nodes searched at the end of each iteration. */
+	uint64_t depth_nodes[PLY_MAX];
+};
+
+#endif
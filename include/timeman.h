@@ -17,6 +17,7 @@
 #ifndef TIMEMAN_H
 #define TIMEMAN_H
 
+#include <pthread.h>
 #include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -57,24 +58,42 @@ struct timeinfo {
 	double best_move_changes;
 
 	double multiplier;
+
+	/* If set, search calls this after every completed iteration. */
+	void (*iteration)(struct timeinfo *ti, int depth, uint64_t nodes, move_t best_move);
+	void *data;
+
+	/* Filled in by search before it returns. */
+	uint64_t searched_nodes;
+	int searched_depth, searched_sel_depth;
+
+	/* Set by the timer thread once maximal has elapsed. */
+	atomic_int timeout;
+
+	int timer_running;
+	int timer_done;
+	pthread_t timer;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
 };
 
 void time_init(struct position *pos, struct timeinfo *ti);
 
+void time_term(struct timeinfo *ti);
+
 int stop_searching(struct timeinfo *si, move_t best_move);
 
 timepoint_t time_now(void);
 
 static inline timepoint_t time_since(const struct timeinfo *ti) { return time_now() - ti->start; }
 
-/* We should check at least a couple of times per millisecond.
- * We are usually above 1 million nps. Checking every 256 nodes
- * means we check every 256 / 1000000 = 0.000512 s = 0.256 ms.
- * 0x100 = 256.
+/* The clock is watched by a separate timer thread which is started by
+ * time_init. It sets ti->timeout when maximal has elapsed, so that the
+ * search only has to poll an atomic instead of asking the system for
+ * the time.
  */
 static inline int check_time(const struct searchinfo *si) {
-	return !(si->nodes & (0x100 - 1)) && si->ti && time_since(si->ti) >= si->ti->maximal && si->ti->stop_on_time
-	    && !atomic_load_explicit(&uciponder, memory_order_relaxed);
+	return si->ti && atomic_load_explicit(&si->ti->timeout, memory_order_relaxed);
 }
 
 #endif
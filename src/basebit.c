@@ -14,11 +14,17 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "attackgen.h"
 #include "bitbase.h"
@@ -35,13 +41,51 @@
 #define BITBASE_KXKX_POSITIONS_PER_ENTRY (BITBASE_KXKX_BITS_PER_ENTRY / BITBASE_KXKX_BITS_PER_POSITION)
 #define BITBASE_KXKX_TABLE_SIZE          (BITBASE_KXKX_INDEX_MAX * BITBASE_KXKX_BITS_PER_POSITION / BITBASE_KXKX_BITS_PER_ENTRY)
 
-uint32_t *bitbase_KXKX;
+/* Threads work on chunks of this many consecutive indices. It is a multiple
+ * of the positions per entry of both tables, so no two threads ever store to
+ * the same entry.
+ */
+#define BITBASE_CHUNK_SIZE (1l << 16)
+
+struct worker {
+	pthread_t thread;
+	long total;
+	long counter;
+};
+
+_Atomic uint32_t *bitbase_KXKX;
 uint32_t *invalid_KXKX;
-uint32_t bitbase_KPK[BITBASE_KPK_TABLE_SIZE]   = { 0 };
-uint32_t bitbase_KPKP[BITBASE_KPKP_TABLE_SIZE] = { 0 };
-uint32_t bitbase_KRKP[BITBASE_KRKP_TABLE_SIZE] = { 0 };
 
-static void write_bitbase(char *name, uint32_t *bitbase, size_t table_size);
+/* The builtin bitbases before they are compressed. */
+static _Atomic uint32_t table_KPK[BITBASE_KPK_INDEX_MAX / BITBASE_KXKX_POSITIONS_PER_ENTRY];
+static _Atomic uint32_t table_KPKP[BITBASE_KPKP_INDEX_MAX / BITBASE_KXKX_POSITIONS_PER_ENTRY];
+static _Atomic uint32_t table_KRKP[BITBASE_KRKP_INDEX_MAX / BITBASE_KXKX_POSITIONS_PER_ENTRY];
+
+/* The generic bitbases that are loaded and the one being generated. */
+static struct bitbase bitbases[BITBASES_MAX];
+static int bitbases_num;
+static const struct bitbase *generating;
+static const char *directory = "files";
+
+/* The table being generated. Entries are only ever stored by the thread
+ * owning the chunk, but they are probed by all threads during an iteration.
+ */
+static _Atomic uint32_t *table;
+static uint32_t *invalid;
+static long index_max;
+static int (*setup_position)(struct position *pos, long index);
+static unsigned (*probe)(const struct position *pos);
+
+static int jobs;
+static struct worker *workers;
+static atomic_long next_index;
+static atomic_long chunks_done;
+
+static pthread_mutex_t progress_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char *progress_name;
+static int progress_percent;
+
+static void write_bitbase(char *name, _Atomic uint32_t *t, long size);
 
 static long bitbase_KXKX_index_by_square(int turn, int king_white, int piece_white, int square_white, int king_black,
                                   int piece_black, int square_black) {
@@ -77,31 +121,37 @@ static long bitbase_KXKX_index(const struct position *pos) {
 	                                    square_black);
 }
 
-static unsigned bitbase_KXKX_probe_by_index(long index) {
+/* Both the KXKX table and the generic tables pack 16 positions in every entry
+ * and keep a separate table with 1 bit per position for invalid positions.
+ */
+static unsigned table_probe_by_index(_Atomic uint32_t *t, long index) {
 	long lookup_index = index / BITBASE_KXKX_POSITIONS_PER_ENTRY;
 	long bit_index    = BITBASE_KXKX_BITS_PER_POSITION * (index % BITBASE_KXKX_POSITIONS_PER_ENTRY);
-	return (bitbase_KXKX[lookup_index] >> bit_index) & BITBASE_KXKX_BITS_MASK;
+	return (atomic_load_explicit(&t[lookup_index], memory_order_relaxed) >> bit_index) & BITBASE_KXKX_BITS_MASK;
 }
 
-static unsigned bitbase_KXKX_probe(const struct position *pos) { return bitbase_KXKX_probe_by_index(bitbase_KXKX_index(pos)); }
-
-static void bitbase_KXKX_store_by_index(long index, unsigned eval) {
-	long lookup_index           = index / BITBASE_KXKX_POSITIONS_PER_ENTRY;
-	long bit_index              = BITBASE_KXKX_BITS_PER_POSITION * (index % BITBASE_KXKX_POSITIONS_PER_ENTRY);
-	bitbase_KXKX[lookup_index] &= ~(BITBASE_KXKX_BITS_MASK << bit_index);
-	bitbase_KXKX[lookup_index] |= (eval << bit_index);
+static void table_store_by_index(_Atomic uint32_t *t, long index, unsigned eval) {
+	long lookup_index = index / BITBASE_KXKX_POSITIONS_PER_ENTRY;
+	long bit_index    = BITBASE_KXKX_BITS_PER_POSITION * (index % BITBASE_KXKX_POSITIONS_PER_ENTRY);
+	uint32_t entry    = atomic_load_explicit(&t[lookup_index], memory_order_relaxed);
+	entry             = (entry & ~(BITBASE_KXKX_BITS_MASK << bit_index)) | (eval << bit_index);
+	atomic_store_explicit(&t[lookup_index], entry, memory_order_relaxed);
 }
 
-static void invalid_KXKX_store_by_index(long index) {
-	long lookup_index           = index / BITBASE_KXKX_BITS_PER_ENTRY;
-	long bit_index              = index % BITBASE_KXKX_BITS_PER_ENTRY;
-	invalid_KXKX[lookup_index] |= (1 << bit_index);
+static void invalid_store_by_index(uint32_t *t, long index) {
+	long lookup_index = index / BITBASE_KXKX_BITS_PER_ENTRY;
+	long bit_index    = index % BITBASE_KXKX_BITS_PER_ENTRY;
+	t[lookup_index]  |= (1 << bit_index);
 }
 
-static unsigned invalid_KXKX_probe_by_index(long index) {
+static unsigned invalid_probe_by_index(const uint32_t *t, long index) {
 	long lookup_index = index / BITBASE_KXKX_BITS_PER_ENTRY;
 	long bit_index    = index % BITBASE_KXKX_BITS_PER_ENTRY;
-	return (invalid_KXKX[lookup_index] >> bit_index) & 0x1;
+	return (t[lookup_index] >> bit_index) & 0x1;
+}
+
+static unsigned bitbase_KXKX_probe(const struct position *pos) {
+	return table_probe_by_index(bitbase_KXKX, bitbase_KXKX_index(pos));
 }
 
 static inline int legal_position(const struct position *pos, int king_white, int piece_white, int square_white,
@@ -127,6 +177,95 @@ static inline int legal_position(const struct position *pos, int king_white, int
 	return 1;
 }
 
+/* Sets up the position of index and returns whether it is legal. */
+static int bitbase_KXKX_position(struct position *pos, long index) {
+	int turn         = index / (64l * 6 * 64 * 64 * 6 * 64);
+	int king_white   = (index % (64 * 6 * 64 * 64 * 6 * 64)) / (6 * 64 * 64 * 6 * 64);
+	int piece_white  = (index % (6 * 64 * 64 * 6 * 64)) / (64 * 64 * 6 * 64);
+	int square_white = (index % (64 * 64 * 6 * 64)) / (64 * 6 * 64);
+	int king_black   = (index % (64 * 6 * 64)) / (6 * 64);
+	int piece_black  = (index % (6 * 64)) / 64;
+	int square_black = (index % (64)) / 1;
+
+	memset(pos, 0, sizeof(*pos));
+	pos->turn                = turn;
+	pos->piece[WHITE][KING]  = bitboard(king_white);
+	pos->mailbox[king_white] = WHITE_KING;
+	pos->piece[BLACK][KING]  = bitboard(king_black);
+	pos->mailbox[king_black] = BLACK_KING;
+	if (piece_white) {
+		pos->piece[WHITE][piece_white] = bitboard(square_white);
+		pos->mailbox[square_white]     = piece_white;
+	}
+	if (piece_black) {
+		pos->piece[BLACK][piece_black] = bitboard(square_black);
+		pos->mailbox[square_black]     = piece_black + 6;
+	}
+	pos->piece[WHITE][ALL] = pos->piece[WHITE][KING] | pos->piece[WHITE][piece_white];
+	pos->piece[BLACK][ALL] = pos->piece[BLACK][KING] | pos->piece[BLACK][piece_black];
+
+	return legal_position(pos, king_white, piece_white, square_white, king_black, piece_black, square_black);
+}
+
+/* Sets up the position of index in the generic bitbase being generated and
+ * returns whether it is legal. Identical pieces are only legal in increasing
+ * square order, the other orders are never probed.
+ */
+static int generating_position(struct position *pos, long index) {
+	int turn;
+	int squares[2][BITBASE_PIECES_MAX + 1];
+	bitbase_squares(generating, index, &turn, squares);
+
+	memset(pos, 0, sizeof(*pos));
+	pos->turn = turn;
+	for (int side = 0; side < 2; side++) {
+		int color = side ? BLACK : WHITE;
+		for (int i = 0; i <= generating->pieces_num[side]; i++) {
+			int piece  = i ? generating->pieces[side][i - 1] : KING;
+			int square = squares[side][i];
+			if (pos->mailbox[square])
+				return 0;
+			if (i > 1 && piece == generating->pieces[side][i - 2] && square < squares[side][i - 1])
+				return 0;
+			pos->piece[color][piece] |= bitboard(square);
+			pos->piece[color][ALL]   |= bitboard(square);
+			pos->mailbox[square]      = colored_piece(piece, color);
+		}
+	}
+
+	return !generate_checkers(pos, !pos->turn) && distance(squares[0][0], squares[1][0]) > 1;
+}
+
+static unsigned generating_probe(const struct position *pos) {
+	if (bitbase_side(generating, pos) == WHITE)
+		return table_probe_by_index(table, bitbase_index(generating, pos, WHITE));
+
+	for (int i = 0; i < bitbases_num; i++)
+		if (bitbase_side(&bitbases[i], pos) != -1)
+			return bitbase_probe(&bitbases[i], pos, WHITE);
+
+	fprintf(stderr, "error: missing bitbase for capture or promotion\n");
+	exit(3);
+}
+
+static int next_chunk(long *begin, long *end) {
+	*begin = atomic_fetch_add(&next_index, BITBASE_CHUNK_SIZE);
+	*end   = *begin + BITBASE_CHUNK_SIZE < index_max ? *begin + BITBASE_CHUNK_SIZE : index_max;
+	return *begin < index_max;
+}
+
+static void report_progress(void) {
+	long chunks = (index_max + BITBASE_CHUNK_SIZE - 1) / BITBASE_CHUNK_SIZE;
+	long done   = atomic_fetch_add(&chunks_done, 1) + 1;
+	int percent = 100 * done / chunks;
+	pthread_mutex_lock(&progress_mutex);
+	if (percent > progress_percent) {
+		progress_percent = percent;
+		fprintf(stderr, "\r%s: %3d%%%s", progress_name, percent, percent == 100 ? "\n" : "");
+	}
+	pthread_mutex_unlock(&progress_mutex);
+}
+
 static int mate(const struct position *pos) {
 	move_t moves[MOVES_MAX];
 	struct pstate pstate;
@@ -139,102 +278,48 @@ static int mate(const struct position *pos) {
 	return pstate.checkers != 0ull ? 2 : 1;
 }
 
-int main(void) {
-	magicbitboard_init();
-	attackgen_init();
-	bitboard_init();
-
+static void *init_worker(void *arg) {
+	struct worker *w = arg;
 	struct position pos;
-	bitbase_KXKX = calloc(BITBASE_KXKX_TABLE_SIZE, sizeof(*bitbase_KXKX));
-	invalid_KXKX = calloc(BITBASE_KXKX_TABLE_SIZE / BITBASE_KXKX_BITS_PER_POSITION, sizeof(*bitbase_KXKX));
-
-	long total   = 0;
-	long counter = 0;
-	for (long index = 0; index < BITBASE_KXKX_INDEX_MAX; index++) {
-		bitbase_KXKX_store_by_index(index, BITBASE_UNKNOWN);
-		int turn         = index / (64l * 6 * 64 * 64 * 6 * 64);
-		int king_white   = (index % (64 * 6 * 64 * 64 * 6 * 64)) / (6 * 64 * 64 * 6 * 64);
-		int piece_white  = (index % (6 * 64 * 64 * 6 * 64)) / (64 * 64 * 6 * 64);
-		int square_white = (index % (64 * 64 * 6 * 64)) / (64 * 6 * 64);
-		int king_black   = (index % (64 * 6 * 64)) / (6 * 64);
-		int piece_black  = (index % (6 * 64)) / 64;
-		int square_black = (index % (64)) / 1;
-
-		memset(&pos, 0, sizeof(pos));
-		pos.turn                = turn;
-		pos.piece[WHITE][KING]  = bitboard(king_white);
-		pos.mailbox[king_white] = WHITE_KING;
-		pos.piece[BLACK][KING]  = bitboard(king_black);
-		pos.mailbox[king_black] = BLACK_KING;
-		if (piece_white) {
-			pos.piece[WHITE][piece_white] = bitboard(square_white);
-			pos.mailbox[square_white]     = piece_white;
-		}
-		if (piece_black) {
-			pos.piece[BLACK][piece_black] = bitboard(square_black);
-			pos.mailbox[square_black]     = piece_black + 6;
-		}
-		pos.piece[WHITE][ALL] = pos.piece[WHITE][KING] | pos.piece[WHITE][piece_white];
-		pos.piece[BLACK][ALL] = pos.piece[BLACK][KING] | pos.piece[BLACK][piece_black];
-
-		if (!legal_position(&pos, king_white, piece_white, square_white, king_black, piece_black,
-		                    square_black)) {
-			total++;
-			invalid_KXKX_store_by_index(index);
-			continue;
-		}
+	long begin, end;
+	while (next_chunk(&begin, &end)) {
+		for (long index = begin; index < end; index++) {
+			table_store_by_index(table, index, BITBASE_UNKNOWN);
+			if (!setup_position(&pos, index)) {
+				w->total++;
+				invalid_store_by_index(invalid, index);
+				continue;
+			}
 
-		int m = mate(&pos);
-		if (m == 2 && pos.turn == BLACK) {
-			counter++;
-			bitbase_KXKX_store_by_index(index, BITBASE_WIN);
-		}
-		else if (m == 2 && pos.turn == WHITE) {
-			counter++;
-			bitbase_KXKX_store_by_index(index, BITBASE_LOSE);
-		}
-		else if (m == 1) {
-			counter++;
-			bitbase_KXKX_store_by_index(index, BITBASE_DRAW);
+			int m = mate(&pos);
+			if (m == 2 && pos.turn == BLACK) {
+				w->counter++;
+				table_store_by_index(table, index, BITBASE_WIN);
+			}
+			else if (m == 2 && pos.turn == WHITE) {
+				w->counter++;
+				table_store_by_index(table, index, BITBASE_LOSE);
+			}
+			else if (m == 1) {
+				w->counter++;
+				table_store_by_index(table, index, BITBASE_DRAW);
+			}
 		}
+		report_progress();
 	}
-	printf("There are %ld total legal positions.\n", total);
-	printf("There are %ld positions where a checkmate or stalemate occured.\n", counter);
+	return NULL;
+}
 
-	int iteration = 1;
-	int changed   = 1;
-	while (changed) {
-		changed   = 0;
-		total     = 0;
-		clock_t t = clock();
-		for (long index = 0; index < BITBASE_KXKX_INDEX_MAX; index++) {
-			if (invalid_KXKX_probe_by_index(index) || bitbase_KXKX_probe_by_index(index) != BITBASE_UNKNOWN)
+static void *iteration_worker(void *arg) {
+	struct worker *w = arg;
+	struct position pos;
+	long begin, end;
+	while (next_chunk(&begin, &end)) {
+		for (long index = begin; index < end; index++) {
+			if (invalid_probe_by_index(invalid, index) || table_probe_by_index(table, index) != BITBASE_UNKNOWN)
 				continue;
 
-			int turn         = index / (64l * 6 * 64 * 64 * 6 * 64);
-			int king_white   = (index % (64 * 6 * 64 * 64 * 6 * 64)) / (6 * 64 * 64 * 6 * 64);
-			int piece_white  = (index % (6 * 64 * 64 * 6 * 64)) / (64 * 64 * 6 * 64);
-			int square_white = (index % (64 * 64 * 6 * 64)) / (64 * 6 * 64);
-			int king_black   = (index % (64 * 6 * 64)) / (6 * 64);
-			int piece_black  = (index % (6 * 64)) / 64;
-			int square_black = (index % (64)) / 1;
-
-			memset(&pos, 0, sizeof(pos));
-			pos.turn                = turn;
-			pos.piece[WHITE][KING]  = bitboard(king_white);
-			pos.mailbox[king_white] = WHITE_KING;
-			pos.piece[BLACK][KING]  = bitboard(king_black);
-			pos.mailbox[king_black] = BLACK_KING;
-			if (piece_white) {
-				pos.piece[WHITE][piece_white] = bitboard(square_white);
-				pos.mailbox[square_white]     = piece_white;
-			}
-			if (piece_black) {
-				pos.piece[BLACK][piece_black] = bitboard(square_black);
-				pos.mailbox[square_black]     = piece_black + 6;
-			}
-			pos.piece[WHITE][ALL] = pos.piece[WHITE][KING] | pos.piece[WHITE][piece_white];
-			pos.piece[BLACK][ALL] = pos.piece[BLACK][KING] | pos.piece[BLACK][piece_black];
+			setup_position(&pos, index);
 
 			move_t moves[MOVES_MAX];
 			movegen_legal(&pos, moves, MOVETYPE_ALL);
@@ -242,7 +327,7 @@ int main(void) {
 			int exists[4] = { 0 };
 			for (move_t *ptr = moves; *ptr; ptr++) {
 				do_move(&pos, ptr);
-				unsigned p = bitbase_KXKX_probe(&pos);
+				unsigned p = probe(&pos);
 				undo_move(&pos, ptr);
 				exists[p] = 1;
 				if (p == BITBASE_WIN && pos.turn == WHITE)
@@ -251,40 +336,247 @@ int main(void) {
 					break;
 			}
 
-			if (exists[BITBASE_WIN] && pos.turn == WHITE) {
-				bitbase_KXKX_store_by_index(index, BITBASE_WIN);
-				counter++;
-				total++;
-				changed = 1;
-			}
-			else if (exists[BITBASE_LOSE] && pos.turn == BLACK) {
-				bitbase_KXKX_store_by_index(index, BITBASE_LOSE);
-				counter++;
-				total++;
-				changed = 1;
-			}
-			else if (!exists[BITBASE_UNKNOWN] && exists[BITBASE_DRAW]) {
-				bitbase_KXKX_store_by_index(index, BITBASE_DRAW);
-				counter++;
-				total++;
-				changed = 1;
-			}
-			else if (!exists[BITBASE_UNKNOWN]) {
-				bitbase_KXKX_store_by_index(index, pos.turn == WHITE ? BITBASE_LOSE : BITBASE_WIN);
-				counter++;
-				total++;
-				changed = 1;
-			}
+			unsigned eval;
+			if (exists[BITBASE_WIN] && pos.turn == WHITE)
+				eval = BITBASE_WIN;
+			else if (exists[BITBASE_LOSE] && pos.turn == BLACK)
+				eval = BITBASE_LOSE;
+			else if (!exists[BITBASE_UNKNOWN] && exists[BITBASE_DRAW])
+				eval = BITBASE_DRAW;
+			else if (!exists[BITBASE_UNKNOWN])
+				eval = pos.turn == WHITE ? BITBASE_LOSE : BITBASE_WIN;
+			else
+				continue;
+
+			table_store_by_index(table, index, eval);
+			w->total++;
 		}
-		printf("Iteration %d took %ld seconds.\n", iteration++, (clock() - t) / CLOCKS_PER_SEC);
+		report_progress();
+	}
+	return NULL;
+}
+
+/* Runs func on every thread over the whole index range, handing out chunks
+ * of BITBASE_CHUNK_SIZE indices at a time.
+ */
+static void run_workers(const char *name, void *(*func)(void *)) {
+	progress_name    = name;
+	progress_percent = -1;
+	atomic_store(&next_index, 0);
+	atomic_store(&chunks_done, 0);
+
+	for (int i = 0; i < jobs; i++) {
+		workers[i].total   = 0;
+		workers[i].counter = 0;
+		if (pthread_create(&workers[i].thread, NULL, func, &workers[i])) {
+			fprintf(stderr, "error: failed to create thread\n");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < jobs; i++)
+		pthread_join(workers[i].thread, NULL);
+}
+
+static double seconds_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fills table with the evaluations of all index_max positions. Positions that
+ * are still unknown after the last iteration are draws, invalid positions
+ * remain BITBASE_INVALID.
+ */
+static void generate_table(const char *name) {
+	char str[64];
+	sprintf(str, "%s initialisation", name);
+	run_workers(str, &init_worker);
+	long total   = 0;
+	long counter = 0;
+	for (int i = 0; i < jobs; i++) {
+		total   += workers[i].total;
+		counter += workers[i].counter;
+	}
+	printf("There are %ld total legal positions.\n", total);
+	printf("There are %ld positions where a checkmate or stalemate occured.\n", counter);
+
+	/* Threads read positions that other threads may be storing at the same
+	 * time, so a position can be resolved in this iteration or the next one
+	 * depending on timing. Every stored evaluation is final and we iterate
+	 * until nothing changes, so the resulting table does not depend on it.
+	 */
+	int iteration = 1;
+	for (total = 1; total;) {
+		sprintf(str, "%s iteration %d", name, iteration);
+		double t = seconds_now();
+		run_workers(str, &iteration_worker);
+		total = 0;
+		for (int i = 0; i < jobs; i++)
+			total += workers[i].total;
+		counter += total;
+		printf("Iteration %d took %.0f seconds.\n", iteration++, seconds_now() - t);
 		printf("Stored %ld positions.\n", total);
 		printf("There are now %ld stored positions.\n", counter);
 	}
 
 	/* Clean up. */
-	for (long index = 0; index < BITBASE_KXKX_INDEX_MAX; index++)
-		if (!invalid_KXKX_probe_by_index(index) && bitbase_KXKX_probe_by_index(index) == BITBASE_UNKNOWN)
-			bitbase_KXKX_store_by_index(index, BITBASE_DRAW);
+	for (long index = 0; index < index_max; index++)
+		if (!invalid_probe_by_index(invalid, index) && table_probe_by_index(table, index) == BITBASE_UNKNOWN)
+			table_store_by_index(table, index, BITBASE_DRAW);
+}
+
+static struct bitbase *generate(const char *name);
+
+/* Makes sure that the bitbases of all positions after a capture or promotion
+ * are loaded.
+ */
+static void generate_children(const struct bitbase *bb) {
+	for (int side = 0; side < 2; side++) {
+		for (int promote = -1; promote < bb->pieces_num[side]; promote++) {
+			if (promote != -1 && bb->pieces[side][promote] != PAWN)
+				continue;
+			for (int piece = KNIGHT; piece <= (promote != -1 ? QUEEN : KNIGHT); piece++) {
+				for (int capture = -1; capture < bb->pieces_num[!side]; capture++) {
+					if (promote == -1 && capture == -1)
+						continue;
+					char name[16], *ptr = name;
+					for (int s = 0; s < 2; s++) {
+						*ptr++ = 'K';
+						for (int i = 0; i < bb->pieces_num[s]; i++) {
+							if (s == side && i == promote)
+								*ptr++ = " PNBRQ"[piece];
+							else if (s != side && i == capture)
+								continue;
+							else
+								*ptr++ = " PNBRQ"[bb->pieces[s][i]];
+						}
+					}
+					*ptr = '\0';
+					generate(name);
+				}
+			}
+		}
+	}
+}
+
+/* Loads the bitbase from directory, or generates and saves it together with
+ * every smaller bitbase it depends on.
+ */
+static struct bitbase *generate(const char *name) {
+	struct bitbase bb;
+	if (bitbase_parse(&bb, name)) {
+		fprintf(stderr, "error: bad bitbase '%s'\n", name);
+		exit(1);
+	}
+
+	for (int i = 0; i < bitbases_num; i++)
+		if (!strcmp(bitbases[i].name, bb.name))
+			return &bitbases[i];
+
+	if (bitbases_num == BITBASES_MAX) {
+		fprintf(stderr, "error: too many bitbases\n");
+		exit(1);
+	}
+
+	char path[BUFSIZ];
+	snprintf(path, sizeof(path), "%s/%s.bb", directory, bb.name);
+	if (bitbase_load(&bb, path)) {
+		generate_children(&bb);
+
+		printf("Generating %s.\n", bb.name);
+		double t       = seconds_now();
+		generating     = &bb;
+		index_max      = bb.size;
+		table          = calloc((index_max + 15) / 16, sizeof(*table));
+		invalid        = calloc((index_max + 31) / 32, sizeof(*invalid));
+		setup_position = &generating_position;
+		probe          = &generating_probe;
+		if (!table || !invalid) {
+			fprintf(stderr, "error: failed to allocate memory\n");
+			exit(2);
+		}
+
+		generate_table(bb.name);
+
+		if (bitbase_save(&bb, (uint32_t *)table, path) || bitbase_load(&bb, path)) {
+			fprintf(stderr, "error: failed to save bitbase '%s'\n", path);
+			exit(3);
+		}
+		free(table);
+		free(invalid);
+		printf("Generated %s in %.0f seconds.\n", bb.name, seconds_now() - t);
+	}
+
+	bitbases[bitbases_num] = bb;
+	return &bitbases[bitbases_num++];
+}
+
+int main(int argc, char **argv) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	jobs      = cpus > 0 ? cpus : 1;
+
+	static struct option opts[] = {
+		{      "jobs", required_argument, NULL, 'j' },
+		{ "directory", required_argument, NULL, 'd' },
+		{        NULL,                 0, NULL,   0 },
+	};
+
+	char *endptr;
+	int c, option_index = 0;
+	while ((c = getopt_long(argc, argv, "j:d:", opts, &option_index)) != -1) {
+		switch (c) {
+		case 'j':
+			errno = 0;
+			jobs  = strtol(optarg, &endptr, 10);
+			if (errno || *endptr != '\0' || jobs < 1) {
+				fprintf(stderr, "error: bad argument: jobs\n");
+				return 1;
+			}
+			break;
+		case 'd':
+			directory = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-j jobs] [-d directory] [bitbase ...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	magicbitboard_init();
+	attackgen_init();
+	bitboard_init();
+
+	workers = calloc(jobs, sizeof(*workers));
+	if (!workers) {
+		fprintf(stderr, "error: failed to allocate memory\n");
+		return 2;
+	}
+	printf("Generating with %d threads.\n", jobs);
+
+	/* Generic bitbases such as KRPKR, stored in directory as KRPKR.bb. */
+	if (optind < argc) {
+		for (int i = optind; i < argc; i++)
+			generate(argv[i]);
+		for (int i = 0; i < bitbases_num; i++)
+			bitbase_unload(&bitbases[i]);
+		free(workers);
+		return 0;
+	}
+
+	struct position pos;
+	bitbase_KXKX = calloc(BITBASE_KXKX_TABLE_SIZE, sizeof(*bitbase_KXKX));
+	invalid_KXKX = calloc(BITBASE_KXKX_TABLE_SIZE / BITBASE_KXKX_BITS_PER_POSITION, sizeof(*invalid_KXKX));
+	if (!bitbase_KXKX || !invalid_KXKX) {
+		fprintf(stderr, "error: failed to allocate memory\n");
+		return 2;
+	}
+
+	table          = bitbase_KXKX;
+	invalid        = invalid_KXKX;
+	index_max      = BITBASE_KXKX_INDEX_MAX;
+	setup_position = &bitbase_KXKX_position;
+	probe          = &bitbase_KXKX_probe;
+	generate_table("KXKX");
 
 	/* KPK bitbase. */
 	for (int turn = 0; turn < 2; turn++) {
@@ -297,7 +589,7 @@ int main(void) {
 					pos.piece[WHITE][PAWN] = bitboard(pawn_white);
 					pos.piece[BLACK][KING] = bitboard(king_black);
 					unsigned p             = bitbase_KXKX_probe(&pos);
-					bitbase_KPK_store(&pos, p);
+					table_store_by_index(table_KPK, bitbase_KPK_index(&pos), p);
 				}
 			}
 		}
@@ -316,7 +608,7 @@ int main(void) {
 						pos.piece[BLACK][KING] = bitboard(king_black);
 						pos.piece[BLACK][PAWN] = bitboard(pawn_black);
 						unsigned p             = bitbase_KXKX_probe(&pos);
-						bitbase_KPKP_store(&pos, p);
+						table_store_by_index(table_KPKP, bitbase_KPKP_index(&pos), p);
 					}
 				}
 			}
@@ -336,39 +628,90 @@ int main(void) {
 						pos.piece[BLACK][KING] = bitboard(king_black);
 						pos.piece[BLACK][PAWN] = bitboard(pawn_black);
 						unsigned p             = bitbase_KXKX_probe(&pos);
-						bitbase_KRKP_store(&pos, p);
+						table_store_by_index(table_KRKP, bitbase_KRKP_index(&pos), p);
 					}
 				}
 			}
 		}
 	}
-	write_bitbase("kpk", bitbase_KPK, BITBASE_KPK_TABLE_SIZE);
-	write_bitbase("kpkp", bitbase_KPKP, BITBASE_KPKP_TABLE_SIZE);
-	write_bitbase("krkp", bitbase_KRKP, BITBASE_KRKP_TABLE_SIZE);
+	write_bitbase("kpk", table_KPK, BITBASE_KPK_INDEX_MAX);
+	write_bitbase("kpkp", table_KPKP, BITBASE_KPKP_INDEX_MAX);
+	write_bitbase("krkp", table_KRKP, BITBASE_KRKP_INDEX_MAX);
 
 	free(bitbase_KXKX);
 	free(invalid_KXKX);
+	free(workers);
 }
 
-static void write_bitbase(char *name, uint32_t *bitbase, size_t table_size) {
+static void append_run(uint32_t *runs, long *n, unsigned eval, int length) {
+	runs[*n / 4] |= (uint32_t)(eval << 6 | (length - 1)) << (8 * (*n % 4));
+	(*n)++;
+}
+
+/* Compresses the table into blocks of runs as described in bitbase.h. */
+static void write_bitbase(char *name, _Atomic uint32_t *t, long size) {
 	char path[BUFSIZ] = "files/";
 	strcat(path, name);
 	strcat(path, ".bin");
 
+	long blocks       = size / BITBASE_BLOCK_SIZE;
+	uint32_t *entries = calloc(blocks + (size + 3) / 4, sizeof(*entries));
+	if (!entries) {
+		fprintf(stderr, "error: failed to allocate memory\n");
+		exit(2);
+	}
+	uint32_t *runs = entries + blocks;
+
+	long n = 0;
+	for (long block = 0; block < blocks; block++) {
+		long first     = block * BITBASE_BLOCK_SIZE;
+		entries[block] = n;
+
+		/* Invalid positions at the start of the block join the first
+		 * valid run.
+		 */
+		unsigned eval = BITBASE_INVALID;
+		for (long index = first; index < first + BITBASE_BLOCK_SIZE && eval == BITBASE_INVALID; index++)
+			eval = table_probe_by_index(t, index);
+		if (eval == BITBASE_INVALID)
+			eval = BITBASE_DRAW;
+
+		int length = 0;
+		for (long index = first; index < first + BITBASE_BLOCK_SIZE; index++) {
+			unsigned p = table_probe_by_index(t, index);
+			if ((p != eval && p != BITBASE_INVALID) || length == BITBASE_RUN_LENGTH) {
+				append_run(runs, &n, eval, length);
+				length = 0;
+				if (p != BITBASE_INVALID)
+					eval = p;
+			}
+			length++;
+		}
+		append_run(runs, &n, eval, length);
+	}
+
 	FILE *f = fopen(path, "w");
 	if (!f) {
 		fprintf(stderr, "Failed to open file %s.", path);
+		free(entries);
 		return;
 	}
 
-	for (size_t i = 0; i < table_size; i++) {
+	for (long i = 0; i < blocks + (n + 3) / 4; i++) {
 		if (i % 8)
 			fprintf(f, " ");
 		else if (i)
 			fprintf(f, "\n");
-		fprintf(f, "0x%08X,", bitbase[i]);
+		fprintf(f, "0x%08X,", entries[i]);
 	}
 	fprintf(f, "\n");
 
 	fclose(f);
+	free(entries);
+
+	/* The headers check the size of the tables they are compiled with. */
+	char upper[16] = { 0 };
+	for (int i = 0; name[i] && i < 15; i++)
+		upper[i] = toupper((unsigned char)name[i]);
+	printf("Wrote %s with BITBASE_%s_RUN_ENTRIES %ld.\n", path, upper, (n + 3) / 4);
 }
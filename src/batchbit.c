@@ -17,11 +17,15 @@
 #define _GNU_SOURCE
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -33,6 +37,17 @@
 #include "nnue.h"
 #include "position.h"
 
+/* A feature file, written by loader_export, starts with FEATURES_MAGIC and
+ * the number of records. Every record holds the eval, fullmove, result, side
+ * to move and number of features followed by the features from both points of
+ * view, with room for FEATURES_MAX features each. Only positions that are
+ * never skipped regardless of the loader options are written.
+ */
+#define FEATURES_MAGIC       "bitfeat"
+#define FEATURES_MAX         31
+#define FEATURES_HEADER_SIZE 16
+#define FEATURES_RECORD_SIZE (8 + 4 * FEATURES_MAX)
+
 struct entry {
 	int result;
 	uint64_t piece[2][7];
@@ -40,6 +55,10 @@ struct entry {
 	int fullmove;
 	unsigned flag;
 	int32_t eval;
+
+	/* Only set for entries of feature files. */
+	int features_num;
+	uint16_t features[2][FEATURES_MAX];
 };
 
 struct batch {
@@ -51,6 +70,57 @@ struct batch {
 	float *result;
 
 	void *_next;
+
+	/* In the compressed sparse row format ind1 and ind2 only hold the
+	 * feature indices, and the features of sample i are found between
+	 * offsets[i] and offsets[i + 1].
+	 */
+	int csr;
+	int32_t *offsets;
+
+	size_t _capacity;
+};
+
+struct datafile {
+	const unsigned char *data;
+	size_t size;
+	struct bitindex index;
+
+	int features;
+	size_t records;
+};
+
+/* A range of whole games, from the offset begin to end of a mapped file. The
+ * reading starts over at begin when it reaches end.
+ */
+struct range {
+	const unsigned char *data;
+	int version;
+	int features;
+	size_t begin;
+	size_t end;
+	size_t offset;
+};
+
+/* Every worker decodes its own range of every file, switching range after
+ * each game, and draws the entries at random from a reservoir of
+ * reservoir_size entries if it is nonzero.
+ */
+struct shard {
+	struct dataloader *dataloader;
+	pthread_t thread;
+	uint64_t seed;
+
+	struct range *ranges;
+	int ranges_num;
+	int range;
+
+	struct position pos;
+	signed char result;
+
+	struct entry *reservoir;
+	size_t reservoir_size;
+	size_t reservoir_num;
 };
 
 struct dataloader {
@@ -60,7 +130,7 @@ struct dataloader {
 	int stop;
 
 	int jobs;
-	pthread_t *thread;
+	struct shard *shards;
 
 	int num_batches;
 	struct batch *first;
@@ -68,25 +138,19 @@ struct dataloader {
 	pthread_cond_t condfetch;
 	pthread_cond_t condready;
 	pthread_mutex_t mutex;
-	pthread_mutex_t readmutex;
 
 	double random_skip;
+	int csr;
 	int ply;
 	int wdl_skip;
 	int use_result;
 
 	uint64_t baseseed;
 
-	FILE *f;
-
-	struct position pos;
-	signed char result;
+	struct datafile *files;
+	int files_num;
 };
 
-static inline uint16_t make_index_virtual(int turn, int square, int piece, int king_square) {
-	return orient(turn, square, king_square) + piece_to_index[turn][piece] + FT_IN_DIMS;
-}
-
 /* From https://github.com/official-stockfish/nnue-pytorch
  * but fitted to bitbit's own data. */
 double win_rate_model(int fullmove, int32_t eval, int result) {
@@ -118,13 +182,40 @@ int wdl_skip(int fullmove, int32_t eval, int result, uint64_t *seed) {
 	return bernoulli(1.0 - win_rate_model(fullmove, eval, result), seed);
 }
 
+/* Batches freed by the trainer are kept for the workers to reuse. */
+static struct batch *pool;
+static pthread_mutex_t poolmutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void batch_destroy(struct batch *batch) {
+	free(batch->ind1);
+	free(batch->ind2);
+	free(batch->eval);
+	free(batch->result);
+	free(batch->offsets);
+	free(batch);
+}
+
 void *batch_alloc(size_t requested_size) {
-	struct batch *batch = calloc(1, sizeof(*batch));
-	batch->ind1         = malloc(4 * 32 * requested_size * sizeof(*batch->ind1));
-	batch->ind2         = malloc(4 * 32 * requested_size * sizeof(*batch->ind2));
-	batch->eval         = malloc(requested_size * sizeof(*batch->eval));
-	batch->result       = malloc(requested_size * sizeof(*batch->result));
-	batch->_next        = NULL;
+	pthread_mutex_lock(&poolmutex);
+	struct batch *batch = pool;
+	if (batch)
+		pool = batch->_next;
+	pthread_mutex_unlock(&poolmutex);
+
+	if (batch && batch->_capacity != requested_size) {
+		batch_destroy(batch);
+		batch = NULL;
+	}
+	if (!batch) {
+		batch            = calloc(1, sizeof(*batch));
+		batch->ind1      = malloc(4 * 32 * requested_size * sizeof(*batch->ind1));
+		batch->ind2      = malloc(4 * 32 * requested_size * sizeof(*batch->ind2));
+		batch->eval      = malloc(requested_size * sizeof(*batch->eval));
+		batch->result    = malloc(requested_size * sizeof(*batch->result));
+		batch->offsets   = malloc((requested_size + 1) * sizeof(*batch->offsets));
+		batch->_capacity = requested_size;
+	}
+	batch->_next = NULL;
 
 	return batch;
 }
@@ -132,11 +223,20 @@ void *batch_alloc(size_t requested_size) {
 void batch_free(struct batch *batch) {
 	if (!batch)
 		return;
-	free(batch->ind1);
-	free(batch->ind2);
-	free(batch->eval);
-	free(batch->result);
-	free(batch);
+	pthread_mutex_lock(&poolmutex);
+	batch->_next = pool;
+	pool         = batch;
+	pthread_mutex_unlock(&poolmutex);
+}
+
+static void batch_pool_clear(void) {
+	pthread_mutex_lock(&poolmutex);
+	while (pool) {
+		struct batch *next = pool->_next;
+		batch_destroy(pool);
+		pool = next;
+	}
+	pthread_mutex_unlock(&poolmutex);
 }
 
 void batch_append(struct dataloader *dataloader, struct batch *batch) {
@@ -150,78 +250,158 @@ void batch_append(struct dataloader *dataloader, struct batch *batch) {
 	}
 }
 
-int entry_fetch(struct dataloader *dataloader, struct entry *entries, size_t n) {
+static void feature_decode(struct range *range, struct entry *entry) {
+	const unsigned char *record = range->data + range->offset;
+	range->offset              += FEATURES_RECORD_SIZE;
+
+	entry->eval         = (int16_t)((uint16_t)record[0] | (uint16_t)record[1] << 8);
+	entry->fullmove     = (uint16_t)record[2] | (uint16_t)record[3] << 8;
+	entry->result       = (signed char)record[4];
+	entry->turn         = record[5];
+	entry->features_num = record[6];
+	entry->flag         = 0;
+	for (int side = 0; side < 2; side++) {
+		const unsigned char *features = record + 8 + 2 * FEATURES_MAX * side;
+		for (int i = 0; i < entry->features_num; i++)
+			entry->features[side][i] = (uint16_t)features[2 * i] | (uint16_t)features[2 * i + 1] << 8;
+	}
+}
+
+/* The records were verified by bitindex_build_mem or map_file. */
+static void entry_decode(struct shard *shard, struct entry *entry) {
 	move_t move;
 	int32_t eval;
 	unsigned char flag;
 
-	pthread_mutex_lock(&dataloader->readmutex);
+	struct range *range = &shard->ranges[shard->range];
+	if (range->offset >= range->end)
+		range->offset = range->begin;
+	if (shard->ranges_num > 1) {
+		size_t offset = range->offset;
+		if (!range->features)
+			read_move_mem(range->data, &move, &offset, range->end);
+		if (range->features || !move) {
+			shard->range = (shard->range + 1) % shard->ranges_num;
+			range        = &shard->ranges[shard->range];
+			if (range->offset >= range->end)
+				range->offset = range->begin;
+		}
+	}
+
+	if (range->features) {
+		feature_decode(range, entry);
+		return;
+	}
+
+	const unsigned char *data = range->data;
+	entry->features_num       = 0;
+	read_move_mem(data, &move, &range->offset, range->end);
+	if (move) {
+		do_move(&shard->pos, &move);
+	}
+	else {
+		if (range->version == 1)
+			read_position_mem(data, &shard->pos, &range->offset, range->end);
+		else
+			read_position2_mem(data, &shard->pos, &range->offset, range->end);
+		read_result_mem(data, &shard->result, &range->offset, range->end);
+	}
+	if (range->version == 1)
+		read_eval_mem(data, &eval, &range->offset, range->end);
+	else
+		read_eval2_mem(data, &eval, &range->offset, range->end);
+	read_flag_mem(data, &flag, &range->offset, range->end);
+
+	entry->eval = eval;
+	entry->flag = flag;
+	memcpy(entry->piece, shard->pos.piece, sizeof(entry->piece));
+	entry->turn     = shard->pos.turn;
+	entry->result   = shard->result;
+	entry->fullmove = shard->pos.fullmove;
+}
+
+int entry_fetch(struct shard *shard, struct entry *entries, size_t n) {
+	struct dataloader *dataloader = shard->dataloader;
 
 	pthread_mutex_lock(&dataloader->mutex);
 	if (dataloader->error || dataloader->stop) {
 		pthread_mutex_unlock(&dataloader->mutex);
-		pthread_mutex_unlock(&dataloader->readmutex);
 		return 1;
 	}
 	pthread_mutex_unlock(&dataloader->mutex);
-	int r;
+
 	for (size_t i = 0; i < n;) {
-		if ((r = read_move(dataloader->f, &move))) {
-			if (r == 2 && feof(dataloader->f)) {
-				fseek(dataloader->f, 0, SEEK_SET);
-				continue;
-			}
-			else {
-				pthread_mutex_lock(&dataloader->mutex);
-				dataloader->stop = dataloader->error = 1;
-				pthread_cond_broadcast(&dataloader->condready);
-				pthread_mutex_unlock(&dataloader->mutex);
-				pthread_mutex_unlock(&dataloader->readmutex);
-				return 1;
-			}
+		if (!shard->reservoir_size) {
+			entry_decode(shard, &entries[i++]);
 		}
-		if (move) {
-			do_move(&dataloader->pos, &move);
+		else if (shard->reservoir_num < shard->reservoir_size) {
+			entry_decode(shard, &shard->reservoir[shard->reservoir_num++]);
 		}
 		else {
-			if (read_position(dataloader->f, &dataloader->pos)
-			    || read_result(dataloader->f, &dataloader->result)) {
-				pthread_mutex_lock(&dataloader->mutex);
-				dataloader->stop = dataloader->error = 1;
-				pthread_cond_broadcast(&dataloader->condready);
-				pthread_mutex_unlock(&dataloader->mutex);
-				pthread_mutex_unlock(&dataloader->readmutex);
-				return 1;
-			}
+			struct entry *entry = &shard->reservoir[xorshift64(&shard->seed) % shard->reservoir_size];
+			entries[i++]        = *entry;
+			entry_decode(shard, entry);
 		}
+	}
+	return 0;
+}
 
-		if (read_eval(dataloader->f, &eval) || read_flag(dataloader->f, &flag)) {
-			pthread_mutex_lock(&dataloader->mutex);
-			dataloader->stop = dataloader->error = 1;
-			pthread_cond_broadcast(&dataloader->condready);
-			pthread_mutex_unlock(&dataloader->mutex);
-			pthread_mutex_unlock(&dataloader->readmutex);
-			return 1;
-		}
+static inline uint64_t mirror_files(uint64_t b) {
+	b = ((b >> 1) & 0x5555555555555555) | ((b & 0x5555555555555555) << 1);
+	b = ((b >> 2) & 0x3333333333333333) | ((b & 0x3333333333333333) << 2);
+	b = ((b >> 4) & 0x0F0F0F0F0F0F0F0F) | ((b & 0x0F0F0F0F0F0F0F0F) << 4);
+	return b;
+}
 
-		struct entry *entry = &entries[i];
-		entry->eval         = eval;
-		entry->flag         = flag;
-		memcpy(entry->piece, dataloader->pos.piece, sizeof(entry->piece));
-		entry->turn     = dataloader->pos.turn;
-		entry->result   = dataloader->result;
-		entry->fullmove = dataloader->pos.fullmove;
+/* Appends the features of entry from the point of view of turn in increasing
+ * order, so that they never have to be sorted. The pieces are visited in the
+ * order of piece_to_index and the bitboards are oriented before the squares
+ * are extracted.
+ */
+static int32_t *append_features(int32_t *ind, int32_t row, int csr, const struct entry *entry, int turn,
+                                int virtual) {
+	int king_square = ctz(entry->piece[turn][KING]);
+	int mirror      = file_of(king_square) >= 4;
+	uint32_t offset = virtual ? FT_IN_DIMS : PS_END * king_bucket[orient_horizontal(turn, king_square)];
+	for (int piece = PAWN; piece <= KING; piece++) {
+		for (int i = 0; i < 2; i++) {
+			int color = i ? other_color(turn) : turn;
+			/* The king of the side to move is left out from both points of
+			 * view.
+			 */
+			if (piece == KING && color == entry->turn)
+				continue;
+			uint64_t b = entry->piece[color][piece];
+			if (turn == BLACK)
+				b = rotate_bytes(b);
+			if (mirror)
+				b = mirror_files(b);
+			uint32_t base = offset + piece_to_index[turn][colored_piece(piece, color)];
+			for (; b; b = clear_ls1b(b)) {
+				if (!csr)
+					*ind++ = row;
+				*ind++ = base + ctz(b);
+			}
+		}
+	}
+	return ind;
+}
 
-		i++;
+static int32_t *append_cached_features(int32_t *ind, int32_t row, int csr, const uint16_t *features, int n,
+                                       int virtual) {
+	for (int i = 0; i < n; i++) {
+		if (!csr)
+			*ind++ = row;
+		*ind++ = virtual ? FT_IN_DIMS + features[i] % PS_END : features[i];
 	}
-	pthread_mutex_unlock(&dataloader->readmutex);
-	return 0;
+	return ind;
 }
 
 void *batch_worker(void *ptr) {
-	struct dataloader *dataloader = ptr;
+	struct shard *shard           = ptr;
+	struct dataloader *dataloader = shard->dataloader;
 
-	uint64_t seed                 = dataloader->baseseed + gettid();
+	shard->seed                   = dataloader->baseseed + gettid();
 
 	struct entry *entries         = calloc(dataloader->internal_size, sizeof(*entries));
 	size_t entry_index            = dataloader->internal_size;
@@ -242,12 +422,14 @@ void *batch_worker(void *ptr) {
 		struct batch *batch = batch_alloc(dataloader->requested_size);
 		batch->size         = 0;
 		batch->ind_active   = 0;
+		batch->csr          = dataloader->csr;
 
-		size_t counter1 = 0, counter2 = 0;
+		int32_t *ind1 = batch->ind1;
+		int32_t *ind2 = batch->ind2;
 
 		while (batch->size < dataloader->requested_size) {
 			if (entry_index >= dataloader->internal_size) {
-				if (entry_fetch(dataloader, entries, dataloader->internal_size))
+				if (entry_fetch(shard, entries, dataloader->internal_size))
 					break;
 				entry_index = 0;
 			}
@@ -263,75 +445,36 @@ void *batch_worker(void *ptr) {
 				continue;
 
 			int skip = (eval == VALUE_NONE) || (flag & FLAG_SKIP)
-			        || bernoulli(dataloader->random_skip, &seed)
+			        || bernoulli(dataloader->random_skip, &shard->seed)
 			        || (dataloader->wdl_skip && result != RESULT_UNKNOWN
-			            && wdl_skip(entry->fullmove, eval, result, &seed));
+			            && wdl_skip(entry->fullmove, eval, result, &shard->seed));
 			if (skip)
 				continue;
 
 			batch->eval[batch->size]   = ((float)(FV_SCALE * eval)) / (127 * 64);
 			batch->result[batch->size] = result != RESULT_UNKNOWN ? (result + 1.0) / 2.0 : 0.5;
 
-			int index, square;
-			int king_square[]   = { ctz(entry->piece[BLACK][KING]), ctz(entry->piece[WHITE][KING]) };
-			size_t counter1_was = counter1;
-			size_t counter2_was = counter2;
-			for (int piece = PAWN; piece <= KING; piece++) {
-				for (int turn = 0; turn <= 1; turn++) {
-					if (piece == KING && turn == entry->turn)
-						continue;
-					uint64_t b = entry->piece[turn][piece];
-					while (b) {
-						batch->ind_active += 2;
-						square             = ctz(b);
-						index = make_index(entry->turn, square, colored_piece(piece, turn),
-						                   king_square[entry->turn]);
-						batch->ind1[counter1++] = batch->size;
-						batch->ind1[counter1++] = index;
-
-						index                   = make_index(other_color(entry->turn), square,
-						                                     colored_piece(piece, turn),
-						                                     king_square[other_color(entry->turn)]);
-						batch->ind2[counter2++] = batch->size;
-						batch->ind2[counter2++] = index;
-
-						index                   = make_index_virtual(entry->turn, square,
-						                                             colored_piece(piece, turn),
-						                                             king_square[entry->turn]);
-						batch->ind1[counter1++] = batch->size;
-						batch->ind1[counter1++] = index;
-
-						index = make_index_virtual(other_color(entry->turn), square,
-						                           colored_piece(piece, turn),
-						                           king_square[other_color(entry->turn)]);
-						batch->ind2[counter2++] = batch->size;
-						batch->ind2[counter2++] = index;
-						b                       = clear_ls1b(b);
-					}
-				}
-			}
-			for (size_t c = counter1_was + 3; c < counter1; c += 2) {
-				size_t d = c;
-
-				while (d > counter1_was + 1 && batch->ind1[d - 2] > batch->ind1[d]) {
-					int32_t temp        = batch->ind1[d - 2];
-					batch->ind1[d - 2]  = batch->ind1[d];
-					batch->ind1[d]      = temp;
-					d                  -= 2;
-				}
+			if (batch->csr)
+				batch->offsets[batch->size] = ind1 - batch->ind1;
+			if (entry->features_num) {
+				int n = entry->features_num;
+				ind1  = append_cached_features(ind1, batch->size, batch->csr, entry->features[0], n, 0);
+				ind1  = append_cached_features(ind1, batch->size, batch->csr, entry->features[0], n, 1);
+				ind2  = append_cached_features(ind2, batch->size, batch->csr, entry->features[1], n, 0);
+				ind2  = append_cached_features(ind2, batch->size, batch->csr, entry->features[1], n, 1);
 			}
-			for (size_t c = counter2_was + 3; c < counter2; c += 2) {
-				size_t d = c;
-
-				while (d > counter2_was + 1 && batch->ind2[d - 2] > batch->ind2[d]) {
-					int32_t temp        = batch->ind2[d - 2];
-					batch->ind2[d - 2]  = batch->ind2[d];
-					batch->ind2[d]      = temp;
-					d                  -= 2;
-				}
+			else {
+				int turn = entry->turn;
+				ind1     = append_features(ind1, batch->size, batch->csr, entry, turn, 0);
+				ind1     = append_features(ind1, batch->size, batch->csr, entry, turn, 1);
+				ind2     = append_features(ind2, batch->size, batch->csr, entry, other_color(turn), 0);
+				ind2     = append_features(ind2, batch->size, batch->csr, entry, other_color(turn), 1);
 			}
 			batch->size++;
 		}
+		batch->ind_active = batch->csr ? ind1 - batch->ind1 : (ind1 - batch->ind1) / 2;
+		if (batch->csr)
+			batch->offsets[batch->size] = batch->ind_active;
 		pthread_mutex_lock(&dataloader->mutex);
 		if (dataloader->error || dataloader->stop) {
 			dataloader->num_batches--;
@@ -375,14 +518,136 @@ struct batch *batch_fetch(void *ptr) {
 	return batch;
 }
 
-void *loader_open(const char *s, size_t requested_size, int jobs, double random_skip, int wdl_skip, int use_result) {
+static int map_file(struct datafile *file, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		return 1;
+	}
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size > 0)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "error: failed to map file '%s'\n", path);
+		return 1;
+	}
+	file->data = map;
+	file->size = st.st_size;
+
+	if (file->size >= FEATURES_HEADER_SIZE && !memcmp(file->data, FEATURES_MAGIC, sizeof(FEATURES_MAGIC))) {
+		file->features = 1;
+		for (int i = 0; i < 8; i++)
+			file->records |= (size_t)file->data[8 + i] << (8 * i);
+		if (!file->records || (file->size - FEATURES_HEADER_SIZE) / FEATURES_RECORD_SIZE != file->records
+		    || (file->size - FEATURES_HEADER_SIZE) % FEATURES_RECORD_SIZE) {
+			fprintf(stderr, "error: bad feature data in file '%s'\n", path);
+			return 1;
+		}
+		return 0;
+	}
+
+	/* A sidecar index saved for this file is trusted to describe whole
+	 * records, saving a pass over the file.
+	 */
+	if (bitindex_load(&file->index, path, file->data, file->size)
+	    && bitindex_build_mem(&file->index, file->data, file->size)) {
+		fprintf(stderr, "error: bad training data in file '%s'\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+static void loader_free(struct dataloader *dataloader) {
+	for (int i = 0; dataloader->shards && i < dataloader->jobs; i++) {
+		free(dataloader->shards[i].ranges);
+		free(dataloader->shards[i].reservoir);
+	}
+	free(dataloader->shards);
+	for (int i = 0; i < dataloader->files_num; i++) {
+		if (dataloader->files[i].data)
+			munmap((void *)dataloader->files[i].data, dataloader->files[i].size);
+		bitindex_free(&dataloader->files[i].index);
+	}
+	free(dataloader->files);
+	free(dataloader);
+}
+
+/* Gives every worker an equal part of the games of every file. A worker whose
+ * part of every file is empty reads all of every file.
+ */
+static void make_shards(struct dataloader *dataloader, size_t shuffle) {
+	int jobs           = dataloader->jobs;
+	dataloader->shards = calloc(jobs, sizeof(*dataloader->shards));
+	for (int i = 0; i < jobs; i++) {
+		struct shard *shard = &dataloader->shards[i];
+		shard->dataloader   = dataloader;
+		shard->ranges       = calloc(dataloader->files_num, sizeof(*shard->ranges));
+		for (int all = 0; all < 2 && !shard->ranges_num; all++) {
+			for (int f = 0; f < dataloader->files_num; f++) {
+				const struct datafile *file = &dataloader->files[f];
+				size_t num                  = file->features ? file->records : file->index.games_num;
+				size_t first                = all ? 0 : i * num / jobs;
+				size_t last                 = all ? num : (i + 1) * num / jobs;
+				if (first == last)
+					continue;
+				struct range *range = &shard->ranges[shard->ranges_num++];
+				range->data         = file->data;
+				range->version      = file->index.version;
+				range->features     = file->features;
+				if (file->features) {
+					range->begin = FEATURES_HEADER_SIZE + first * FEATURES_RECORD_SIZE;
+					range->end   = FEATURES_HEADER_SIZE + last * FEATURES_RECORD_SIZE;
+				}
+				else {
+					range->begin = file->index.offsets[first];
+					range->end   = last < num ? file->index.offsets[last] : file->size;
+				}
+				range->offset = range->begin;
+			}
+		}
+		shard->reservoir_size = shuffle ? (shuffle + jobs - 1) / jobs : 0;
+		shard->reservoir      = shuffle ? malloc(shard->reservoir_size * sizeof(*shard->reservoir)) : NULL;
+	}
+}
+
+/* Expands the list of glob patterns s separated by ':'. */
+static int expand_patterns(const char *s, glob_t *g) {
+	char *patterns = strdup(s), *saveptr;
+	int flags      = GLOB_NOCHECK | GLOB_BRACE;
+	for (char *pattern = strtok_r(patterns, ":", &saveptr); pattern; pattern = strtok_r(NULL, ":", &saveptr)) {
+		if (glob(pattern, flags, NULL, g)) {
+			fprintf(stderr, "error: failed to expand pattern '%s'\n", pattern);
+			free(patterns);
+			globfree(g);
+			return 1;
+		}
+		flags |= GLOB_APPEND;
+	}
+	free(patterns);
+	if (!(flags & GLOB_APPEND)) {
+		fprintf(stderr, "error: no files given\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* As loader_open, but the batches are in the compressed sparse row format if
+ * csr is set, and every position passes through a reservoir of shuffle
+ * positions from which the batches are drawn at random. The path s can be a
+ * list of glob patterns separated by ':', such as "data/selfplay-*.bit", and
+ * the workers read the games of all files interleaved.
+ */
+void *loader_open2(const char *s, size_t requested_size, int jobs, double random_skip, int wdl_skip, int use_result,
+                   int csr, size_t shuffle) {
 	if (jobs <= 0)
 		jobs = 1;
-	FILE *f = fopen(s, "rb");
-	if (!f) {
-		fprintf(stderr, "error: failed to open file '%s'\n", s);
+
+	glob_t g = { 0 };
+	if (expand_patterns(s, &g))
 		return NULL;
-	}
+
 	struct dataloader *dataloader = calloc(1, sizeof(*dataloader));
 	dataloader->jobs              = jobs;
 	dataloader->requested_size    = requested_size;
@@ -390,26 +655,123 @@ void *loader_open(const char *s, size_t requested_size, int jobs, double random_
 	dataloader->random_skip       = random_skip;
 	dataloader->wdl_skip          = wdl_skip;
 	dataloader->use_result        = use_result;
+	dataloader->csr               = csr;
 	dataloader->num_batches       = 0;
-	dataloader->f                 = f;
+	dataloader->files             = calloc(g.gl_pathc, sizeof(*dataloader->files));
+
+	for (size_t i = 0; i < g.gl_pathc; i++) {
+		dataloader->files_num++;
+		if (map_file(&dataloader->files[i], g.gl_pathv[i])) {
+			globfree(&g);
+			loader_free(dataloader);
+			return NULL;
+		}
+	}
+	globfree(&g);
 
 	pthread_mutex_init(&dataloader->mutex, NULL);
-	pthread_mutex_init(&dataloader->readmutex, NULL);
 	pthread_cond_init(&dataloader->condready, NULL);
 	pthread_cond_init(&dataloader->condfetch, NULL);
 
 	dataloader->error    = 0;
 
-	dataloader->thread   = malloc(dataloader->jobs * sizeof(*dataloader->thread));
-
 	dataloader->baseseed = time(NULL);
 
+	make_shards(dataloader, shuffle);
+
 	for (int i = 0; i < dataloader->jobs; i++)
-		pthread_create(&dataloader->thread[i], NULL, batch_worker, dataloader);
+		pthread_create(&dataloader->shards[i].thread, NULL, batch_worker, &dataloader->shards[i]);
 
 	return dataloader;
 }
 
+void *loader_open(const char *s, size_t requested_size, int jobs, double random_skip, int wdl_skip, int use_result) {
+	return loader_open2(s, requested_size, jobs, random_skip, wdl_skip, use_result, 0, 0);
+}
+
+static void write_le(unsigned char *p, uint64_t x, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		p[i] = x >> (8 * i);
+}
+
+/* Writes the positions of the training data s, given as for loader_open2, as a
+ * feature file to path. Positions without an evaluation or with the skip flag
+ * are left out, and the features of the remaining positions are computed once
+ * so that the feature file can be read by loader_open2 in place of s without
+ * decoding any positions.
+ */
+int loader_export(const char *s, const char *path) {
+	glob_t g = { 0 };
+	if (expand_patterns(s, &g))
+		return 1;
+
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		globfree(&g);
+		return 1;
+	}
+
+	unsigned char record[FEATURES_RECORD_SIZE] = { 0 };
+	memcpy(record, FEATURES_MAGIC, sizeof(FEATURES_MAGIC));
+	int error        = 0;
+	int write_error  = fwrite(record, 1, FEATURES_HEADER_SIZE, f) != FEATURES_HEADER_SIZE;
+	uint64_t records = 0;
+
+	for (size_t i = 0; i < g.gl_pathc && !error && !write_error; i++) {
+		struct datafile file = { 0 };
+		if (map_file(&file, g.gl_pathv[i])) {
+			error = 1;
+		}
+		else if (file.features) {
+			fprintf(stderr, "error: file '%s' is already a feature file\n", g.gl_pathv[i]);
+			error = 1;
+		}
+		else {
+			struct range range = { .data = file.data, .version = file.index.version, .end = file.size };
+			struct shard shard = { .ranges = &range, .ranges_num = 1 };
+			range.begin        = file.index.offsets[0];
+			range.offset       = file.index.offsets[0];
+			struct entry entry;
+			int32_t features[FEATURES_MAX];
+			while (range.offset < range.end && !write_error) {
+				entry_decode(&shard, &entry);
+				if (entry.eval == VALUE_NONE || (entry.flag & FLAG_SKIP))
+					continue;
+
+				memset(record, 0, sizeof(record));
+				write_le(record, (uint16_t)entry.eval, 2);
+				write_le(record + 2, entry.fullmove, 2);
+				record[4] = entry.result;
+				record[5] = entry.turn;
+				for (int side = 0; side < 2; side++) {
+					int turn  = side ? other_color(entry.turn) : entry.turn;
+					int n     = append_features(features, 0, 1, &entry, turn, 0) - features;
+					record[6] = n;
+					for (int j = 0; j < n; j++)
+						write_le(record + 8 + 2 * FEATURES_MAX * side + 2 * j, features[j], 2);
+				}
+				write_error = fwrite(record, 1, FEATURES_RECORD_SIZE, f) != FEATURES_RECORD_SIZE;
+				records++;
+			}
+		}
+		if (file.data)
+			munmap((void *)file.data, file.size);
+		bitindex_free(&file.index);
+	}
+	globfree(&g);
+
+	if (!error && !write_error) {
+		write_le(record, records, 8);
+		write_error = fseek(f, 8, SEEK_SET) || fwrite(record, 1, 8, f) != 8;
+	}
+	if (fclose(f) || write_error) {
+		fprintf(stderr, "error: failed to write file '%s'\n", path);
+		return 1;
+	}
+	return error;
+}
+
 void loader_close(void *ptr) {
 	struct dataloader *dataloader = ptr;
 
@@ -418,10 +780,9 @@ void loader_close(void *ptr) {
 	pthread_cond_broadcast(&dataloader->condfetch);
 	pthread_mutex_unlock(&dataloader->mutex);
 	for (int i = 0; i < dataloader->jobs; i++)
-		pthread_join(dataloader->thread[i], NULL);
+		pthread_join(dataloader->shards[i].thread, NULL);
 
 	pthread_mutex_destroy(&dataloader->mutex);
-	pthread_mutex_destroy(&dataloader->readmutex);
 	pthread_cond_destroy(&dataloader->condready);
 	pthread_cond_destroy(&dataloader->condfetch);
 
@@ -439,10 +800,8 @@ void loader_close(void *ptr) {
 		fprintf(stderr, "error: an error occured\n");
 	}
 
-	free(dataloader->thread);
-
-	fclose(dataloader->f);
-	free(dataloader);
+	batch_pool_clear();
+	loader_free(dataloader);
 }
 
 void batchbit_init(void) {
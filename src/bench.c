@@ -14,18 +14,25 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
 #include "bench.h"
 
+#include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "history.h"
+#include "interface.h"
 #include "move.h"
 #include "search.h"
 #include "timeman.h"
 #include "util.h"
 
-static const char *fens[] = {
+const char *bench_fens[] = {
 	"rnbqkbnr/2ppppp1/p7/1p5p/7P/N4P2/PPPPP1P1/R1BQKBNR w KQkq - 0 1",
 	"rnbqkbnr/2p1ppp1/p7/1p1p3p/3P3P/N4P2/PPP1P1P1/R1BQKBNR w KQkq - 0 2",
 	"rnbqkbnr/2p1ppp1/p7/3p3p/1p1PP2P/N4P2/PPP3P1/R1BQKBNR w KQkq - 0 3",
@@ -317,39 +324,384 @@ static const char *fens[] = {
 	"8/8/6K1/8/5q2/8/8/k7 w - - 4 180",
 };
 
-static const int nodes = 100000;
-static struct position pos;
+const size_t bench_fens_num = SIZE(bench_fens);
 
-static void *bench_thread(void *tt) {
+#define BENCH_NODES 100000
+
+struct benchresult {
+	uint64_t nodes;
+	timepoint_t time;
+	int depth, sel_depth;
+	move_t move;
+};
+
+struct benchinfo {
+	struct transpositiontable *tt;
+
+	int depth;
+	uint64_t nodes;
+
+	const char **fens;
+	size_t fens_num;
+
+	int verbose;
+
+	struct benchresult *results;
+	timepoint_t time;
+};
+
+static uint64_t nps(uint64_t nodes, timepoint_t time) { return nodes * TPPERSEC / (time > 0 ? time : 1); }
+
+static void *bench_thread(void *arg) {
+	struct benchinfo *bi = arg;
+	struct position pos;
 	struct history h   = { 0 };
-	struct timeinfo ti = { .nodes = nodes };
+	struct timeinfo ti = { .nodes = bi->nodes };
 	move_t move[2];
+
+	transposition_clear(bi->tt);
+
 	timepoint_t start = time_now();
-	for (unsigned i = 0; i < SIZE(fens); i++) {
-		const char *fen = fens[i];
+	for (size_t i = 0; i < bi->fens_num; i++) {
+		const char *fen = bi->fens[i];
 		pos_from_fen2(&pos, fen);
-		printf("position fen %s\n", fen);
-		printf("go nodes %d\n", nodes);
-		search(&pos, 0, 1, &ti, move, tt, &h, 1);
-		print_bestmove(&pos, move[0], move[1]);
+		if (bi->verbose) {
+			printf("position fen %s\n", fen);
+			if (bi->depth)
+				printf("go depth %d\n", bi->depth);
+			else
+				printf("go nodes %" PRIu64 "\n", bi->nodes);
+		}
+
+		timepoint_t t = time_now();
+		search(&pos, bi->depth, bi->verbose, &ti, move, bi->tt, &h, 1);
+		t = time_now() - t;
+
+		if (bi->verbose)
+			print_bestmove(&pos, move[0], move[1]);
+
+		struct benchresult *r = &bi->results[i];
+		r->nodes              = ti.searched_nodes;
+		r->time               = t;
+		r->depth              = ti.searched_depth;
+		r->sel_depth          = ti.searched_sel_depth;
+		r->move               = move[0];
 	}
+	bi->time = time_now() - start;
 
-	printf("time: %" PRId64 " ms\n", (time_now() - start) / TPPERMS);
 	return NULL;
 }
 
-void bench(struct transpositiontable *tt) {
-	pthread_t thread;
+/* Reads one fen per line. Trailing epd operations are ignored, as are empty
+ * lines and lines starting with #.
+ */
+static void free_fens(const char **list, size_t list_num) {
+	for (size_t i = 0; i < list_num; i++)
+		free((char *)list[i]);
+	free(list);
+}
+
+static int read_fens(const char *path, const char ***list, size_t *list_num) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		return 1;
+	}
+
+	size_t size = 0;
+	*list_num   = 0;
+	*list       = NULL;
+
+	char line[BUFSIZ];
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '\0' || line[0] == '#')
+			continue;
+
+		/* Keep the halfmove and fullmove counters only if they are there. */
+		char *field[7] = { line };
+		int fields;
+		for (fields = 1; fields < 7; fields++) {
+			char *c = strchr(field[fields - 1], ' ');
+			if (!c)
+				break;
+			field[fields] = c + 1;
+		}
+		int n = 4;
+		if (fields >= 6 && strspn(field[4], "0123456789") == (size_t)(field[5] - field[4] - 1)
+		    && strspn(field[5], "0123456789") == strcspn(field[5], " "))
+			n = 6;
+		if (fields > n)
+			field[n][-1] = '\0';
+
+		if (!fen_is_ok2(line)) {
+			fprintf(stderr, "error: bad fen '%s' in file '%s'\n", line, path);
+			fclose(f);
+			free_fens(*list, *list_num);
+			*list     = NULL;
+			*list_num = 0;
+			return 1;
+		}
+
+		if (*list_num == size) {
+			size  = size ? 2 * size : 64;
+			*list = realloc(*list, size * sizeof(**list));
+		}
+		(*list)[(*list_num)++] = strdup(line);
+	}
+
+	fclose(f);
+	if (!*list_num) {
+		fprintf(stderr, "error: no positions in file '%s'\n", path);
+		free(*list);
+		*list = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+static int write_json(const char *path, const struct benchinfo *bi, uint64_t nodes) {
+	FILE *f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+	if (!f) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		return 1;
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"positions\": %zu,\n", bi->fens_num);
+	fprintf(f, "\t\"depth\": %d,\n", bi->depth);
+	fprintf(f, "\t\"nodes_limit\": %" PRIu64 ",\n", bi->nodes);
+	fprintf(f, "\t\"hash\": %zu,\n", bi->tt->size * sizeof(*bi->tt->table) / (1024 * 1024));
+	fprintf(f, "\t\"signature\": %" PRIu64 ",\n", nodes);
+	fprintf(f, "\t\"time_ms\": %.3f,\n", (double)bi->time / TPPERMS);
+	fprintf(f, "\t\"nps\": %" PRIu64 ",\n", nps(nodes, bi->time));
+	fprintf(f, "\t\"results\": [\n");
+	for (size_t i = 0; i < bi->fens_num; i++) {
+		const struct benchresult *r = &bi->results[i];
+		char str[8];
+		fprintf(f,
+		        "\t\t{ \"fen\": \"%s\", \"nodes\": %" PRIu64 ", \"time_ms\": %.3f, \"nps\": %" PRIu64
+		        ", \"depth\": %d, \"seldepth\": %d, \"bestmove\": \"%s\" }%s\n",
+		        bi->fens[i], r->nodes, (double)r->time / TPPERMS, nps(r->nodes, r->time), r->depth,
+		        r->sel_depth, r->move ? move_str_algebraic(str, &r->move) : "0000",
+		        i + 1 < bi->fens_num ? "," : "");
+	}
+	fprintf(f, "\t]\n");
+	fprintf(f, "}\n");
+
+	if (f != stdout)
+		fclose(f);
+	return 0;
+}
+
+static void bench_run(struct benchinfo *bi, int threads) {
+	pthread_t *thread = malloc(threads * sizeof(*thread));
 	pthread_attr_t attr;
 
-	if (pthread_attr_init(&attr) || pthread_attr_setstacksize(&attr, 8 * 1024 * 1024)
-	    || pthread_create(&thread, &attr, &bench_thread, tt)) {
+	if (pthread_attr_init(&attr) || pthread_attr_setstacksize(&attr, 8 * 1024 * 1024)) {
 		fprintf(stderr, "error: failed to create thread\n");
 		exit(4);
 	}
 
-	if (pthread_join(thread, NULL)) {
-		fprintf(stderr, "error: pthread_join\n");
-		exit(5);
+	for (int i = 0; i < threads; i++) {
+		if (pthread_create(&thread[i], &attr, &bench_thread, &bi[i])) {
+			fprintf(stderr, "error: failed to create thread\n");
+			exit(4);
+		}
 	}
+
+	for (int i = 0; i < threads; i++) {
+		if (pthread_join(thread[i], NULL)) {
+			fprintf(stderr, "error: pthread_join\n");
+			exit(5);
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+	free(thread);
+}
+
+static uint64_t total_nodes(const struct benchinfo *bi) {
+	uint64_t total = 0;
+	for (size_t i = 0; i < bi->fens_num; i++)
+		total += bi->results[i].nodes;
+	return total;
+}
+
+static void bench_single(struct benchinfo *bi, const char *json) {
+	bi->verbose = 1;
+	bi->results = calloc(bi->fens_num, sizeof(*bi->results));
+	bench_run(bi, 1);
+
+	for (size_t i = 0; i < bi->fens_num; i++) {
+		const struct benchresult *r = &bi->results[i];
+		printf("position %zu nodes %" PRIu64 " time %" PRId64 " nps %" PRIu64 " depth %d seldepth %d\n", i + 1,
+		       r->nodes, r->time / TPPERMS, nps(r->nodes, r->time), r->depth, r->sel_depth);
+	}
+
+	uint64_t total = total_nodes(bi);
+	printf("nodes: %" PRIu64 "\n", total);
+	printf("time: %" PRId64 " ms\n", bi->time / TPPERMS);
+	printf("nps: %" PRIu64 "\n", nps(total, bi->time));
+
+	if (json)
+		write_json(json, bi, total);
+
+	free(bi->results);
+}
+
+/* Runs the bench alone once and then in n threads at the same time. Every
+ * thread has its own transposition table and search state, so the threads
+ * only compete for the caches and memory bandwidth of the machine.
+ */
+static void bench_concurrent(const struct benchinfo *template, int n, size_t bytes, const char *json) {
+	struct benchinfo *bi = malloc(n * sizeof(*bi));
+	for (int i = 0; i < n; i++) {
+		bi[i]         = *template;
+		bi[i].verbose = 0;
+		bi[i].tt      = malloc(sizeof(*bi[i].tt));
+		bi[i].results = calloc(bi[i].fens_num, sizeof(*bi[i].results));
+		if (transposition_alloc(bi[i].tt, bytes)) {
+			fprintf(stderr, "error: failed to allocate transposition table\n");
+			exit(1);
+		}
+	}
+
+	bench_run(bi, 1);
+	uint64_t single_nodes = total_nodes(&bi[0]);
+	uint64_t single_nps   = nps(single_nodes, bi[0].time);
+	printf("single nodes %" PRIu64 " time %" PRId64 " nps %" PRIu64 "\n", single_nodes, bi[0].time / TPPERMS,
+	       single_nps);
+
+	timepoint_t start = time_now();
+	bench_run(bi, n);
+	timepoint_t time = time_now() - start;
+
+	uint64_t total   = 0;
+	for (int i = 0; i < n; i++) {
+		uint64_t nodes  = total_nodes(&bi[i]);
+		total          += nodes;
+		printf("thread %d nodes %" PRIu64 " time %" PRId64 " nps %" PRIu64 "\n", i + 1, nodes,
+		       bi[i].time / TPPERMS, nps(nodes, bi[i].time));
+	}
+
+	uint64_t aggregate_nps = nps(total, time);
+	double efficiency      = single_nps ? (double)aggregate_nps / ((double)n * single_nps) : 0.0;
+
+	printf("threads: %d\n", n);
+	printf("nodes: %" PRIu64 "\n", total);
+	printf("time: %" PRId64 " ms\n", time / TPPERMS);
+	printf("nps: %" PRIu64 "\n", aggregate_nps);
+	printf("nps per thread: %" PRIu64 "\n", aggregate_nps / n);
+	printf("efficiency: %.1f%%\n", 100.0 * efficiency);
+
+	FILE *f = NULL;
+	if (json && !(f = strcmp(json, "-") ? fopen(json, "w") : stdout))
+		fprintf(stderr, "error: failed to open file '%s'\n", json);
+	if (f) {
+		fprintf(f, "{\n");
+		fprintf(f, "\t\"threads\": %d,\n", n);
+		fprintf(f, "\t\"positions\": %zu,\n", template->fens_num);
+		fprintf(f, "\t\"depth\": %d,\n", template->depth);
+		fprintf(f, "\t\"nodes_limit\": %" PRIu64 ",\n", template->nodes);
+		fprintf(f, "\t\"hash\": %zu,\n", bytes / (1024 * 1024));
+		fprintf(f, "\t\"single_nps\": %" PRIu64 ",\n", single_nps);
+		fprintf(f, "\t\"nodes\": %" PRIu64 ",\n", total);
+		fprintf(f, "\t\"time_ms\": %.3f,\n", (double)time / TPPERMS);
+		fprintf(f, "\t\"nps\": %" PRIu64 ",\n", aggregate_nps);
+		fprintf(f, "\t\"efficiency\": %.4f,\n", efficiency);
+		fprintf(f, "\t\"results\": [\n");
+		for (int i = 0; i < n; i++) {
+			uint64_t nodes = total_nodes(&bi[i]);
+			fprintf(f, "\t\t{ \"nodes\": %" PRIu64 ", \"time_ms\": %.3f, \"nps\": %" PRIu64 " }%s\n", nodes,
+			        (double)bi[i].time / TPPERMS, nps(nodes, bi[i].time), i + 1 < n ? "," : "");
+		}
+		fprintf(f, "\t]\n");
+		fprintf(f, "}\n");
+		if (f != stdout)
+			fclose(f);
+	}
+
+	for (int i = 0; i < n; i++) {
+		transposition_free(bi[i].tt);
+		free(bi[i].tt);
+		free(bi[i].results);
+	}
+	free(bi);
+}
+
+int bench(int argc, char **argv, struct transpositiontable *tt) {
+	struct benchinfo bi = {
+		.tt       = tt,
+		.fens     = bench_fens,
+		.fens_num = bench_fens_num,
+	};
+	struct transpositiontable benchtt = { 0 };
+
+	const char *file = NULL, *json = NULL;
+	int64_t depth    = -1, nodes = -1, hash = -1, concurrent = 0;
+
+	char *endptr;
+	for (int i = 1; i < argc; i += 2) {
+		int64_t *a       = NULL;
+		const char **str = NULL;
+		if (!strcmp(argv[i], "depth"))
+			a = &depth;
+		else if (!strcmp(argv[i], "nodes"))
+			a = &nodes;
+		else if (!strcmp(argv[i], "hash"))
+			a = &hash;
+		else if (!strcmp(argv[i], "concurrent"))
+			a = &concurrent;
+		else if (!strcmp(argv[i], "file"))
+			str = &file;
+		else if (!strcmp(argv[i], "json"))
+			str = &json;
+		else
+			return ERR_BAD_ARG;
+
+		if (i == argc - 1)
+			return ERR_MISS_ARG;
+
+		if (str) {
+			*str = argv[i + 1];
+			continue;
+		}
+
+		errno = 0;
+		*a    = strtoll(argv[i + 1], &endptr, 10);
+		if (errno || *endptr != '\0' || *a < 0 || (a == &depth && *a > PLY_MAX / 2)
+		    || ((a == &hash || a == &concurrent) && (*a == 0 || *a > INT_MAX)))
+			return ERR_BAD_ARG;
+	}
+
+	/* A depth without a node limit searches every position to that depth. */
+	bi.depth = max(depth, 0);
+	bi.nodes = nodes >= 0 ? (uint64_t)nodes : depth > 0 ? 0 : BENCH_NODES;
+
+	if (file && read_fens(file, &bi.fens, &bi.fens_num))
+		return DONE;
+
+	if (concurrent) {
+		bench_concurrent(&bi, concurrent, hash > 0 ? (size_t)hash * 1024 * 1024 : tt->size * sizeof(*tt->table), json);
+	}
+	else {
+		if (hash > 0) {
+			if (transposition_alloc(&benchtt, hash * 1024 * 1024)) {
+				fprintf(stderr, "error: failed to allocate transposition table\n");
+				exit(1);
+			}
+			bi.tt = &benchtt;
+		}
+
+		bench_single(&bi, json);
+
+		if (hash > 0)
+			transposition_free(&benchtt);
+	}
+
+	if (file)
+		free_fens(bi.fens, bi.fens_num);
+
+	return DONE;
 }
@@ -0,0 +1,232 @@
+/* bitbit, a bitboard based chess engine written in c.
+ * Copyright (C) 2022-2025 Isak Ellmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include "bitbase.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "position.h"
+
+#define BITBASE_MAGIC "bitbase"
+
+struct bitbaseheader {
+	char magic[8];
+	char name[16];
+	uint64_t size;
+};
+
+static const char piece_chars[] = " PNBRQ";
+
+static inline long radix(int piece) { return piece == PAWN ? 48 : 64; }
+
+static inline size_t table_size(long size) { return (size + 15) / 16; }
+
+static uint32_t material(const struct position *pos, int color) {
+	uint32_t m = 0;
+	for (int piece = PAWN; piece < KING; piece++)
+		m += popcount(pos->piece[color][piece]) << (4 * (piece - PAWN));
+	return m;
+}
+
+int bitbase_parse(struct bitbase *bb, const char *name) {
+	memset(bb, 0, sizeof(*bb));
+	if (name[0] != 'K')
+		return 1;
+
+	int side = -1, total = 0;
+	for (const char *c = name; *c; c++) {
+		if (*c == 'K') {
+			if (++side > 1)
+				return 1;
+			continue;
+		}
+		const char *p = strchr(piece_chars + 1, *c);
+		if (!p || ++total > BITBASE_PIECES_MAX)
+			return 1;
+		bb->pieces[side][bb->pieces_num[side]++] = p - piece_chars;
+	}
+	if (side != 1)
+		return 1;
+
+	for (side = 0; side < 2; side++) {
+		int *pieces = bb->pieces[side];
+		for (int i = 1; i < bb->pieces_num[side]; i++)
+			for (int j = i; j > 0 && pieces[j - 1] < pieces[j]; j--) {
+				int t         = pieces[j];
+				pieces[j]     = pieces[j - 1];
+				pieces[j - 1] = t;
+			}
+	}
+
+	/* The side with the most valuable pieces is white, so KPKR is stored as
+	 * KRKP.
+	 */
+	int k = 0;
+	while (k < bb->pieces_num[0] && k < bb->pieces_num[1] && bb->pieces[0][k] == bb->pieces[1][k])
+		k++;
+	if (k < bb->pieces_num[1] && (k == bb->pieces_num[0] || bb->pieces[0][k] < bb->pieces[1][k])) {
+		struct bitbase t = *bb;
+		for (side = 0; side < 2; side++) {
+			bb->pieces_num[side] = t.pieces_num[!side];
+			memcpy(bb->pieces[side], t.pieces[!side], sizeof(bb->pieces[side]));
+		}
+	}
+
+	char *ptr = bb->name;
+	bb->size  = 2 * 32 * 64;
+	for (side = 0; side < 2; side++) {
+		int *pieces = bb->pieces[side];
+		*ptr++      = 'K';
+		for (int i = 0; i < bb->pieces_num[side]; i++) {
+			*ptr++              = piece_chars[pieces[i]];
+			bb->material[side] += 1 << (4 * (pieces[i] - PAWN));
+			bb->size           *= radix(pieces[i]);
+		}
+	}
+	*ptr = '\0';
+	return 0;
+}
+
+/* Returns the color playing white in the bitbase, or -1 if the material of pos
+ * does not match.
+ */
+int bitbase_side(const struct bitbase *bb, const struct position *pos) {
+	uint32_t white = material(pos, WHITE);
+	uint32_t black = material(pos, BLACK);
+	if (white == bb->material[0] && black == bb->material[1])
+		return WHITE;
+	if (black == bb->material[0] && white == bb->material[1])
+		return BLACK;
+	return -1;
+}
+
+/* The white king has to be on the files a-d. */
+long bitbase_index_by_square(const struct bitbase *bb, int turn, int squares[2][BITBASE_PIECES_MAX + 1]) {
+	long index = turn;
+	index      = 32 * index + 4 * rank_of(squares[0][0]) + file_of(squares[0][0]);
+	index      = 64 * index + squares[1][0];
+	for (int side = 0; side < 2; side++) {
+		for (int i = 0; i < bb->pieces_num[side]; i++) {
+			int piece  = bb->pieces[side][i];
+			int square = squares[side][i + 1];
+			index      = radix(piece) * index + (piece == PAWN ? square - 8 : square);
+		}
+	}
+	return index;
+}
+
+long bitbase_index(const struct bitbase *bb, const struct position *pos, int white_side) {
+	int squares[2][BITBASE_PIECES_MAX + 1];
+	int turn   = pos->turn == white_side;
+	int orient = file_of(orient_horizontal(white_side, ctz(pos->piece[white_side][KING]))) > 3;
+	for (int side = 0; side < 2; side++) {
+		int color       = side ? other_color(white_side) : white_side;
+		int *s          = squares[side];
+		const int *p    = bb->pieces[side];
+		s[0]            = orient_vertical(orient, orient_horizontal(white_side, ctz(pos->piece[color][KING])));
+		uint64_t pieces = 0;
+		for (int i = 0; i < bb->pieces_num[side]; i++) {
+			if (!i || p[i] != p[i - 1])
+				pieces = pos->piece[color][p[i]];
+			s[i + 1] = orient_vertical(orient, orient_horizontal(white_side, ctz(pieces)));
+			pieces   = clear_ls1b(pieces);
+			/* Mirroring can change the order of identical pieces. */
+			for (int j = i; j > 0 && p[j] == p[j - 1] && s[j + 1] < s[j]; j--) {
+				int t    = s[j + 1];
+				s[j + 1] = s[j];
+				s[j]     = t;
+			}
+		}
+	}
+	return bitbase_index_by_square(bb, turn, squares);
+}
+
+void bitbase_squares(const struct bitbase *bb, long index, int *turn, int squares[2][BITBASE_PIECES_MAX + 1]) {
+	for (int side = 1; side >= 0; side--) {
+		for (int i = bb->pieces_num[side] - 1; i >= 0; i--) {
+			int piece             = bb->pieces[side][i];
+			int square            = index % radix(piece);
+			index                /= radix(piece);
+			squares[side][i + 1] = piece == PAWN ? square + 8 : square;
+		}
+	}
+	squares[1][0] = index % 64;
+	index        /= 64;
+	squares[0][0] = 8 * (index % 32 / 4) + index % 4;
+	index        /= 32;
+	*turn         = index;
+}
+
+int bitbase_load(struct bitbase *bb, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return 1;
+
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct bitbaseheader)) {
+		close(fd);
+		return 1;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 1;
+
+	struct bitbaseheader header;
+	memcpy(&header, map, sizeof(header));
+	header.name[sizeof(header.name) - 1] = '\0';
+	if (memcmp(header.magic, BITBASE_MAGIC, sizeof(BITBASE_MAGIC)) || bitbase_parse(bb, header.name)
+	    || strcmp(bb->name, header.name) || header.size != (uint64_t)bb->size
+	    || (size_t)st.st_size != sizeof(header) + table_size(bb->size) * sizeof(*bb->table)) {
+		munmap(map, st.st_size);
+		return 1;
+	}
+
+	bb->table    = (const uint32_t *)((const char *)map + sizeof(header));
+	bb->map      = map;
+	bb->map_size = st.st_size;
+	return 0;
+}
+
+void bitbase_unload(struct bitbase *bb) {
+	if (bb->map)
+		munmap(bb->map, bb->map_size);
+	bb->table = NULL;
+	bb->map   = NULL;
+}
+
+int bitbase_save(const struct bitbase *bb, const uint32_t *table, const char *path) {
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return 1;
+
+	struct bitbaseheader header = { 0 };
+	memcpy(header.magic, BITBASE_MAGIC, sizeof(BITBASE_MAGIC));
+	strcpy(header.name, bb->name);
+	header.size = bb->size;
+
+	int error = fwrite(&header, sizeof(header), 1, f) != 1
+	         || fwrite(table, sizeof(*table), table_size(bb->size), f) != table_size(bb->size);
+	return fclose(f) || error;
+}
@@ -14,10 +14,18 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "attackgen.h"
 #include "bitboard.h"
@@ -28,6 +36,21 @@
 #include "position.h"
 #include "util.h"
 
+/* A range of whole games, checked by one thread. On failure error is set to
+ * the exit code and offset to the byte offset of the bad field.
+ */
+struct shard {
+	pthread_t thread;
+	const unsigned char *data;
+	int version;
+	size_t begin;
+	size_t end;
+
+	int error;
+	size_t offset;
+	char message[256];
+};
+
 static int ends_with(const char *string, const char *end) {
 	unsigned len = strlen(end);
 	if (len > strlen(string))
@@ -36,35 +59,12 @@ static int ends_with(const char *string, const char *end) {
 	return !strcmp(string + (strlen(string) - len), end);
 }
 
-int main(int argc, char **argv) {
-	if (argc < 2 || argc >= 4) {
-		fprintf(stderr, "usage: %s [--shuffle] file\n", argv[0]);
-		return 1;
-	}
-	int shuffle = 0;
-	int i       = 1;
-	if (argc == 3) {
-		if (!strcmp(argv[1], "--shuffle")) {
-			shuffle = 1;
-			i       = 2;
-		}
-		else if (!strcmp(argv[2], "--shuffle")) {
-			shuffle = 1;
-			i       = 1;
-		}
-	}
-	if (!ends_with(argv[i], ".bit"))
-		return 11;
-	FILE *f = fopen(argv[i], "rb");
-	if (!f) {
-		fprintf(stderr, "error: failed to open file '%s'\n", argv[i]);
-		return 2;
-	}
-
-	magicbitboard_init();
-	attackgen_init();
-	bitboard_init();
-	position_init();
+static void *check_shard(void *arg) {
+	struct shard *shard       = arg;
+	const unsigned char *data = shard->data;
+	size_t end                = shard->end;
+	size_t offset             = shard->begin;
+	int version               = shard->version;
 
 	struct position pos = { 0 };
 	signed char result;
@@ -72,87 +72,117 @@ int main(int argc, char **argv) {
 	move_t move;
 	unsigned char flag;
 
-	int first       = 1;
-
-	size_t games    = 0;
-	uint64_t *start = NULL;
-	uint64_t *end   = NULL;
-
-	while (1) {
-		int r;
-		if ((r = read_move(f, &move))) {
-			if (r == 2 && feof(f))
-				break;
-			else
-				return 3;
+	int first = 1;
+	while (offset < end) {
+		shard->offset = offset;
+		if (read_move_mem(data, &move, &offset, end)) {
+			shard->error = 3;
+			return NULL;
 		}
 
 		if (move) {
-			if (first)
-				return 9;
+			if (first) {
+				shard->error = 9;
+				return NULL;
+			}
 			struct pstate ps;
 			pstate_init(&pos, &ps);
 			char movestr[16];
 			char fen[128];
 			if (!pseudo_legal(&pos, &ps, &move) || !legal(&pos, &ps, &move)) {
-				fprintf(stderr, "error: illegal move %s for position %s\n",
-				        move_str_algebraic(movestr, &move), pos_to_fen(fen, &pos));
-				return 4;
+				sprintf(shard->message, "%s for position %s", move_str_algebraic(movestr, &move),
+				        pos_to_fen(fen, &pos));
+				shard->error = 4;
+				return NULL;
 			}
 			do_move(&pos, &move);
 		}
 		else {
-			if (shuffle) {
-				games++;
-				start            = realloc(start, sizeof(*start) * games);
-				end              = realloc(end, sizeof(*end) * games);
-				start[games - 1] = ftell(f) - 2;
-				if (games >= 2)
-					end[games - 2] = start[games - 1];
+			shard->offset = offset;
+			if (version == 1 ? read_position_mem(data, &pos, &offset, end)
+			                 : read_position2_mem(data, &pos, &offset, end)) {
+				shard->error = 5;
+				return NULL;
 			}
-			if (read_position(f, &pos))
-				return 5;
-			if (!pos_is_ok(&pos))
-				return 6;
-			if (read_result(f, &result)
+			if (!pos_is_ok(&pos)) {
+				shard->error = 6;
+				return NULL;
+			}
+			shard->offset = offset;
+			if (read_result_mem(data, &result, &offset, end)
 			    || (result != RESULT_LOSS && result != RESULT_DRAW && result != RESULT_WIN
-			        && result != RESULT_UNKNOWN))
-				return 7;
+			        && result != RESULT_UNKNOWN)) {
+				shard->error = 7;
+				return NULL;
+			}
 		}
 		first = 0;
 
-		if (read_eval(f, &eval) || (eval != VALUE_NONE && (eval < -VALUE_INFINITE || eval > VALUE_INFINITE)))
-			return 8;
-		if (read_flag(f, &flag))
-			return 10;
+		shard->offset = offset;
+		if ((version == 1 ? read_eval_mem(data, &eval, &offset, end) : read_eval2_mem(data, &eval, &offset, end))
+		    || (eval != VALUE_NONE && (eval < -VALUE_INFINITE || eval > VALUE_INFINITE))) {
+			shard->error = 8;
+			return NULL;
+		}
+		shard->offset = offset;
+		if (read_flag_mem(data, &flag, &offset, end)) {
+			shard->error = 10;
+			return NULL;
+		}
 	}
+	return NULL;
+}
 
-	if (!shuffle)
-		return 0;
-
-	if (games >= 1) {
-		end[games - 1] = ftell(f);
-
-		uint64_t seed  = time(NULL);
-		for (size_t k = games - 1; k > 0; k--) {
-			size_t j = xorshift64(&seed) % (k + 1);
-			long t;
-			t        = start[k];
-			start[k] = start[j];
-			start[j] = t;
-			t        = end[k];
-			end[k]   = end[j];
-			end[j]   = t;
-		}
+/* Checks the games of bi, or all of the data if bi is NULL, with jobs
+ * threads and returns the first shard that failed or -1.
+ */
+static int check_file(struct shard *shards, int jobs, const unsigned char *data, size_t size, int version,
+                      size_t begin, const struct bitindex *bi) {
+	size_t games = bi ? bi->games_num : 1;
+	for (int i = 0; i < jobs; i++) {
+		size_t first      = i * games / jobs;
+		size_t last       = (i + 1) * games / jobs;
+		shards[i]         = (struct shard){ 0 };
+		shards[i].data    = data;
+		shards[i].version = version;
+		shards[i].begin   = bi ? bi->offsets[first] : begin;
+		shards[i].end     = bi && last < games ? bi->offsets[last] : size;
+		pthread_create(&shards[i].thread, NULL, check_shard, &shards[i]);
+	}
+
+	int failed = -1;
+	for (int i = 0; i < jobs; i++) {
+		pthread_join(shards[i].thread, NULL);
+		if (failed < 0 && shards[i].error)
+			failed = i;
 	}
+	return failed;
+}
 
-	char *str = malloc(strlen(argv[i]) + 10);
-	if (!str) {
+static const char *error_strings[] = {
+	[3] = "bad move", [4] = "illegal move", [5] = "bad position", [6] = "invalid position",
+	[7] = "bad result", [8] = "bad eval", [9] = "game without a start", [10] = "bad flag",
+};
+
+static int shuffle_games(const char *path, const unsigned char *data, const struct bitindex *bi) {
+	size_t games  = bi->games_num;
+	size_t *order = malloc(games * sizeof(*order));
+	char *str     = malloc(strlen(path) + 10);
+	if ((games && !order) || !str) {
 		fprintf(stderr, "error: malloc\n");
 		return 12;
 	}
+	for (size_t k = 0; k < games; k++)
+		order[k] = k;
+	uint64_t seed = time(NULL);
+	for (size_t k = games; k > 1; k--) {
+		size_t j     = xorshift64(&seed) % k;
+		size_t t     = order[k - 1];
+		order[k - 1] = order[j];
+		order[j]     = t;
+	}
 
-	strcpy(str, argv[i]);
+	strcpy(str, path);
 	str[strlen(str) - 4] = '\0';
 	strcat(str, ".shuffled.bit");
 	FILE *g = fopen(str, "wbx");
@@ -160,30 +190,124 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "error: file '%s' exists\n", str);
 		return 13;
 	}
+	free(str);
 
-	for (size_t k = 0; k < games; k++) {
-		char *bytes = malloc(end[k] - start[k]);
-		if (!bytes) {
-			fprintf(stderr, "error: malloc\n");
-			return 13;
-		}
+	int error = write_header(g, bi->version);
+	for (size_t k = 0; k < games && !error; k++) {
+		size_t begin = bi->offsets[order[k]];
+		size_t end   = order[k] + 1 < games ? bi->offsets[order[k] + 1] : bi->size;
+		error        = fwrite(data + begin, 1, end - begin, g) != end - begin;
+	}
+	free(order);
+	if (fclose(g) || error) {
+		fprintf(stderr, "error: fwrite\n");
+		return 16;
+	}
+	return 0;
+}
 
-		if (fseek(f, start[k], SEEK_SET)) {
-			fprintf(stderr, "error: fseek\n");
-			return 14;
-		}
-		if (fread(bytes, 1, end[k] - start[k], f) != end[k] - start[k]) {
-			fprintf(stderr, "error: fread\n");
-			return 15;
-		}
-		if (fwrite(bytes, 1, end[k] - start[k], g) != end[k] - start[k]) {
-			fprintf(stderr, "error: fwrite\n");
-			return 16;
+int main(int argc, char **argv) {
+	int shuffle = 0, jobs = 1;
+	static struct option opts[] = {
+		{ "shuffle",       no_argument, NULL, 's' },
+		{    "jobs", required_argument, NULL, 'j' },
+		{      NULL,                 0, NULL,   0 },
+	};
+	char *endptr;
+	int c, option_index = 0;
+	int error = 0;
+	while ((c = getopt_long(argc, argv, "sj:", opts, &option_index)) != -1) {
+		switch (c) {
+		case 's':
+			shuffle = 1;
+			break;
+		case 'j':
+			errno = 0;
+			jobs  = strtol(optarg, &endptr, 10);
+			if (errno || *endptr != '\0' || jobs < 1 || jobs > 1024)
+				error = 1;
+			break;
+		default:
+			error = 1;
+			break;
 		}
+	}
+	if (error || optind + 1 != argc) {
+		fprintf(stderr, "usage: %s [--shuffle] [--jobs n] file\n", argv[0]);
+		return 1;
+	}
+	const char *path = argv[optind];
+	if (!ends_with(path, ".bit"))
+		return 11;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st)) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		return 2;
+	}
+	size_t size               = st.st_size;
+	const unsigned char *data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "error: failed to map file '%s'\n", path);
+		return 2;
+	}
+
+	magicbitboard_init();
+	attackgen_init();
+	bitboard_init();
+	position_init();
 
-		free(bytes);
+	int version;
+	size_t begin = 0;
+	if (read_header_mem(data, &version, &begin, size)) {
+		fprintf(stderr, "error: bad header at byte offset 0\n");
+		return 3;
 	}
 
-	fclose(g);
-	return 0;
+	/* The games are split between the threads by the index of the file,
+	 * or by a scan of the file. If the file is too broken to be indexed,
+	 * a single thread checks all of it to find the first error. The
+	 * offsets of a sidecar are not trusted to shuffle the games.
+	 */
+	struct bitindex bi;
+	int sidecar  = !shuffle && !bitindex_load(&bi, path, data, size);
+	int indexed  = sidecar || !bitindex_build_mem(&bi, data, size);
+	size_t games = indexed ? bi.games_num : 1;
+	if ((size_t)jobs > games)
+		jobs = games;
+
+	struct shard *shards = calloc(jobs, sizeof(*shards));
+	int failed           = check_file(shards, jobs, data, size, version, begin, indexed ? &bi : NULL);
+
+	/* Each shard must parse exactly up to the start of the next one, so a
+	 * sidecar which passes the checks of bitindex_load but points into the
+	 * middle of a game can make a good file fail but never a bad file
+	 * pass. A failure is confirmed by a single thread over all games.
+	 */
+	if (failed >= 0 && sidecar)
+		failed = check_file(shards, 1, data, size, version, begin, NULL);
+
+	int ret = 0;
+	if (failed >= 0) {
+		fprintf(stderr, "error: %s at byte offset %zu", error_strings[shards[failed].error], shards[failed].offset);
+		if (shards[failed].message[0])
+			fprintf(stderr, ": %s", shards[failed].message);
+		fprintf(stderr, "\n");
+		ret = shards[failed].error;
+	}
+	else if (shuffle) {
+		/* Only a file without games can not be indexed. */
+		if (!indexed)
+			bi = (struct bitindex){ .size = size, .version = version };
+		ret = shuffle_games(path, data, &bi);
+	}
+
+	free(shards);
+	if (indexed)
+		bitindex_free(&bi);
+	if (data)
+		munmap((void *)data, size);
+	return ret;
 }
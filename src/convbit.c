@@ -151,17 +151,49 @@ static move_t difference(struct position *before, const struct position *after)
 	return 0;
 }
 
+/* Rewrites the .bit file in, of either version, as version. */
+static int convert_bit(FILE *in, FILE *out, int inversion, int version) {
+	struct position pos;
+	move_t move;
+	int32_t eval;
+	signed char result;
+	unsigned char flag;
+	int r;
+
+	if (write_header(out, version))
+		return 1;
+	while (!(r = read_move(in, &move))) {
+		if (write_move(out, move))
+			return 1;
+		if (!move) {
+			if ((inversion == 1 ? read_position(in, &pos) : read_position2(in, &pos))
+			    || read_result(in, &result))
+				return 1;
+			if ((version == 1 ? write_position(out, &pos) : write_position2(out, &pos))
+			    || write_result(out, result))
+				return 1;
+		}
+		if ((inversion == 1 ? read_eval(in, &eval) : read_eval2(in, &eval)) || read_flag(in, &flag))
+			return 1;
+		if ((version == 1 ? write_eval(out, eval) : write_eval2(out, eval)) || write_flag(out, flag))
+			return 1;
+	}
+	return r != 2 || !feof(in);
+}
+
 int main(int argc, char **argv) {
 	double scale_eval = 1.0;
+	int version       = 1;
 	char *inpath, *outpath;
 	static struct option opts[] = {
-		{ "scale-eval", required_argument, NULL, 's' },
-		{         NULL,                 0, NULL,   0 },
+		{  "scale-eval", required_argument, NULL, 's' },
+		{ "bit-version", required_argument, NULL, 'b' },
+		{          NULL,                 0, NULL,   0 },
 	};
 	char *endptr;
 	int c, option_index = 0;
 	int error = 0;
-	while ((c = getopt_long(argc, argv, "s:", opts, &option_index)) != -1) {
+	while ((c = getopt_long(argc, argv, "s:b:", opts, &option_index)) != -1) {
 		switch (c) {
 		case 's':
 			errno      = 0;
@@ -169,6 +201,12 @@ int main(int argc, char **argv) {
 			if (errno || *endptr || scale_eval <= 0.0)
 				error = 1;
 			break;
+		case 'b':
+			errno   = 0;
+			version = strtol(optarg, &endptr, 10);
+			if (errno || *endptr || version < 1 || version > BIT_VERSION)
+				error = 1;
+			break;
 		default:
 			error = 1;
 			break;
@@ -176,7 +214,7 @@ int main(int argc, char **argv) {
 	}
 
 	if (error || optind + 1 >= argc) {
-		fprintf(stderr, "usage: %s [--scale-eval] infile outfile\n", argv[0]);
+		fprintf(stderr, "usage: %s [--scale-eval] [--bit-version] infile outfile\n", argv[0]);
 		return 1;
 	}
 	inpath   = argv[optind];
@@ -198,6 +236,30 @@ int main(int argc, char **argv) {
 	attackgen_init();
 	bitboard_init();
 
+	/* A .bit file, which starts with a header or a zero move, is
+	 * converted to the given version.
+	 */
+	int inversion;
+	if (read_header(in, &inversion)) {
+		fprintf(stderr, "error: bad header in file '%s'\n", inpath);
+		return 4;
+	}
+	if (inversion != 1 || (c = fgetc(in)) == 0) {
+		if (inversion == 1)
+			ungetc(c, in);
+		if (convert_bit(in, out, inversion, version)) {
+			fprintf(stderr, "error: failed to convert file '%s'\n", inpath);
+			return 6;
+		}
+		fclose(in);
+		return fclose(out) != 0;
+	}
+	ungetc(c, in);
+	if (write_header(out, version)) {
+		fprintf(stderr, "error: failed to write file '%s'\n", outpath);
+		return 6;
+	}
+
 	char fen[128]   = { 0 };
 	char move[64]   = { 0 };
 	char score[64]  = { 0 };
@@ -259,7 +321,10 @@ int main(int argc, char **argv) {
 
 			resultsaved = (2 * pos.turn - 1) * resultnow;
 			write_move(out, 0);
-			write_position(out, &pos);
+			if (version == 1)
+				write_position(out, &pos);
+			else
+				write_position2(out, &pos);
 			write_result(out, resultsaved);
 		}
 		else {
@@ -279,7 +344,10 @@ int main(int argc, char **argv) {
 		if (generate_checkers(&pos, pos.turn) || move[4 + 5] || pos.mailbox[square(move + 2 + 5)])
 			flag |= FLAG_SKIP;
 
-		write_eval(out, eval);
+		if (version == 1)
+			write_eval(out, eval);
+		else
+			write_eval2(out, eval);
 		write_flag(out, flag);
 
 #if 0
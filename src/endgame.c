@@ -14,9 +14,11 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include "endgame.h"
 
 #include <ctype.h>
+#include <dirent.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -40,6 +42,10 @@ struct endgame endgame_KXK[2]             = { 0 };
 
 const uint32_t mv[6]                      = { 0, 0x1, 0x10, 0x100, 0x1000, 0x10000 };
 
+static struct bitbase bitbases[BITBASES_MAX];
+static int bitbases_num;
+static int endgames_num;
+
 #ifndef NDEBUG
 static int verify_material(const struct position *pos, int color, int material_verify) {
 	int material = 0;
@@ -68,47 +74,57 @@ void refresh_endgame_key(struct position *pos) {
 	}
 }
 
+/* Sets up a position with the material of str where the strong side, i.e. KR
+ * in KRKP, has color. Returns 1 if the material is symmetric and color is
+ * black, for KPKP for example strong_side will be equal to white.
+ */
+static int endgame_position(struct position *pos, const char *str, int color) {
+	char strong[64] = { 0 };
+	char weak[64] = { 0 };
+	for (size_t i = 0, j = 0, k = 0, K = 0; i < strlen(str); i++) {
+		if (str[i] == 'K')
+			K++;
+		if (K == 1)
+			strong[j++] = str[i];
+		else if (K == 2)
+			weak[k++] = str[i];
+		strong[j] = '\0';
+		weak[k]   = '\0';
+	}
+	if (!strcmp(strong, weak) && !color)
+		return 1;
+	char *ptr = color ? weak : strong;
+	for (size_t i = 0; i < strlen(ptr); i++)
+		ptr[i] = tolower(ptr[i]);
+
+	char pieces[256];
+	sprintf(pieces, "%s%zu/8/8/8/8/8/8/%s%zu", strong, 8 - strlen(strong), weak, 8 - strlen(weak));
+
+	char *fen[] = {
+		pieces, "w", "-", "-", "0", "1",
+	};
+	pos_from_fen(pos, 6, fen);
+	refresh_endgame_key(pos);
+	return 0;
+}
+
 static void endgame_store(const char *str, int32_t (*evaluate)(const struct position *pos, int strong_side)) {
 	struct position pos;
 	for (int color = 0; color < 2; color++) {
-		char strong[64] = { 0 };
-		char weak[64] = { 0 };
-		for (size_t i = 0, j = 0, k = 0, K = 0; i < strlen(str); i++) {
-			if (str[i] == 'K')
-				K++;
-			if (K == 1)
-				strong[j++] = str[i];
-			else if (K == 2)
-				weak[k++] = str[i];
-			strong[j] = '\0';
-			weak[k]   = '\0';
-		}
-		/* For KPKP for example, strong_side will be equal to white. */
-		if (!strcmp(strong, weak) && !color)
+		if (endgame_position(&pos, str, color))
 			continue;
-		char *ptr = color ? weak : strong;
-		for (size_t i = 0; i < strlen(ptr); i++)
-			ptr[i] = tolower(ptr[i]);
-
-		char pieces[256];
-		sprintf(pieces, "%s%zu/8/8/8/8/8/8/%s%zu", strong, 8 - strlen(strong), weak, 8 - strlen(weak));
-
-		char *fen[] = {
-			pieces, "w", "-", "-", "0", "1",
-		};
-		pos_from_fen(&pos, 6, fen);
-		refresh_endgame_key(&pos);
 
 		struct endgame *e = endgame_probe(&pos);
 		if (e) {
 			fprintf(stderr, "error: endgame %s already exists\n", str);
 			exit(1);
 		}
-		e = endgame_get(&pos);
-		if (e->evaluate) {
-			fprintf(stderr, "error: endgame %s entry collision\n", str);
+		if (endgames_num + 1 >= ENDGAMESIZE) {
+			fprintf(stderr, "error: endgame table is full\n");
 			exit(1);
 		}
+		e = endgame_get(&pos);
+		endgames_num++;
 
 		e->evaluate    = evaluate;
 		e->endgame_key = pos.endgame_key;
@@ -116,6 +132,37 @@ static void endgame_store(const char *str, int32_t (*evaluate)(const struct posi
 	}
 }
 
+static int32_t evaluate_bitbase(const struct position *pos, int strong_side);
+
+/* Stores an endgame evaluated by bb, replacing any builtin evaluation. Nothing
+ * is stored unless both colors fit in the table.
+ */
+static int endgame_store_bitbase(const struct bitbase *bb) {
+	struct position pos;
+	int needed = 0;
+	for (int color = 0; color < 2; color++)
+		if (!endgame_position(&pos, bb->name, color) && !endgame_get(&pos)->evaluate)
+			needed++;
+	if (endgames_num + needed >= ENDGAMESIZE) {
+		fprintf(stderr, "error: endgame table is full\n");
+		return 1;
+	}
+
+	for (int color = 0; color < 2; color++) {
+		if (endgame_position(&pos, bb->name, color))
+			continue;
+
+		struct endgame *e = endgame_get(&pos);
+		if (!e->evaluate)
+			endgames_num++;
+		e->evaluate    = &evaluate_bitbase;
+		e->bitbase     = bb;
+		e->endgame_key = pos.endgame_key;
+		e->strong_side = color;
+	}
+	return 0;
+}
+
 /* +---+---+---+---+---+---+---+---+
  * | 6 | 5 | 4 | 3 | 3 | 4 | 5 | 6 |
  * +---+---+---+---+---+---+---+---+
@@ -336,6 +383,40 @@ static int32_t evaluate_KXK(const struct position *pos, int strong_side) {
 	     + 0x8 * push_toward_edge(weak_king) - pos->halfmove;
 }
 
+/* Drives the winning king toward the losing king and the edge, and pushes
+ * the pawns of the winning side.
+ */
+static int32_t evaluate_win(const struct position *pos, int winning_side) {
+	int losing_side    = other_color(winning_side);
+	int winning_king   = ctz(pos->piece[winning_side][KING]);
+	int losing_king    = ctz(pos->piece[losing_side][KING]);
+	int32_t material   = 0;
+	int32_t pawn_bonus = 0;
+	for (int piece = PAWN; piece < KING; piece++)
+		material += material_value[piece]
+		          * (popcount(pos->piece[winning_side][piece]) - popcount(pos->piece[losing_side][piece]));
+	uint64_t pawns = pos->piece[winning_side][PAWN];
+	while (pawns) {
+		int square  = ctz(pawns);
+		pawn_bonus += rank_of(orient_horizontal(winning_side, square));
+		pawns       = clear_ls1b(pawns);
+	}
+	return VALUE_WIN + material + 0x4 * pawn_bonus + push_toward(winning_king, losing_king)
+	     + 0x8 * push_toward_edge(losing_king) - pos->halfmove;
+}
+
+static int32_t evaluate_bitbase(const struct position *pos, int strong_side) {
+	const struct bitbase *bb = endgame_get(pos)->bitbase;
+	unsigned p               = bitbase_probe(bb, pos, strong_side);
+	if (p == BITBASE_DRAW)
+		return 0;
+	else if (p == BITBASE_WIN)
+		return evaluate_win(pos, strong_side);
+	else if (p == BITBASE_LOSE)
+		return -evaluate_win(pos, other_color(strong_side));
+	return VALUE_NONE;
+}
+
 int is_KXK(const struct position *pos, int color) {
 	return !(pos->piece[other_color(color)][ALL] ^ pos->piece[other_color(color)][KING])
 	    && (pos->piece[color][ROOK] || pos->piece[color][QUEEN]
@@ -411,15 +492,9 @@ void undo_endgame_key(struct position *pos, const move_t *move) {
 	}
 }
 
-void endgame_init(void) {
-	uint64_t seed = SEED;
-	for (size_t i = 0; i < SIZE(endgame_keys); i++)
-		endgame_keys[i] = xorshift64(&seed);
-
-#ifndef NDEBUG
-	endgame_init_done = 1;
-#endif
-
+static void endgame_builtin(void) {
+	memset(endgame_table, 0, sizeof(endgame_table));
+	endgames_num = 0;
 	endgame_store("KPK", &evaluate_KPK);
 	endgame_store("KPKP", &evaluate_KPKP);
 	endgame_store("KNPK", &evaluate_KNPK);
@@ -435,6 +510,59 @@ void endgame_init(void) {
 	endgame_store("KQKN", &evaluate_KQKX);
 	endgame_store("KQKB", &evaluate_KQKX);
 	endgame_store("KQKR", &evaluate_KQKX);
+}
+
+/* Loads every bitbase in path generated by basebit, i.e. KRPKR.bb, and uses
+ * it instead of the builtin evaluation of the endgame.
+ */
+void endgame_bitbases(const char *path) {
+	for (int i = 0; i < bitbases_num; i++)
+		bitbase_unload(&bitbases[i]);
+	bitbases_num = 0;
+	endgame_builtin();
+
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "error: failed to open directory '%s'\n", path);
+		return;
+	}
+
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		size_t len = strlen(entry->d_name);
+		if (len < 3 || strcmp(entry->d_name + len - 3, ".bb"))
+			continue;
+		if (bitbases_num == BITBASES_MAX) {
+			fprintf(stderr, "error: too many bitbases\n");
+			break;
+		}
+
+		char file[BUFSIZ];
+		snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+		struct bitbase *bb = &bitbases[bitbases_num];
+		if (bitbase_load(bb, file)) {
+			fprintf(stderr, "error: failed to load bitbase '%s'\n", file);
+			continue;
+		}
+		if (endgame_store_bitbase(bb)) {
+			bitbase_unload(bb);
+			continue;
+		}
+		bitbases_num++;
+	}
+	closedir(dir);
+}
+
+void endgame_init(void) {
+	uint64_t seed = SEED;
+	for (size_t i = 0; i < SIZE(endgame_keys); i++)
+		endgame_keys[i] = xorshift64(&seed);
+
+#ifndef NDEBUG
+	endgame_init_done = 1;
+#endif
+
+	endgame_builtin();
 	for (int color = 0; color < 2; color++) {
 		endgame_KXK[color].evaluate    = &evaluate_KXK;
 		endgame_KXK[color].strong_side = color;
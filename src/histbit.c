@@ -14,8 +14,18 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "attackgen.h"
 #include "endgame.h"
@@ -29,6 +39,44 @@
 #include "position.h"
 #include "util.h"
 
+/* Evaluations from white's point of view in bins of EVAL_BIN centipawns
+ * centered at multiples of EVAL_BIN. The outermost bins also count every
+ * evaluation beyond them.
+ */
+#define EVAL_BIN   100
+#define EVAL_BINS  21
+#define PLIES_BIN  20
+#define PLIES_BINS 16
+
+struct stats {
+	uint64_t piece_square[7][64];
+	uint64_t positions;
+	uint64_t skipped;
+	uint64_t games;
+	uint64_t draws;
+	uint64_t results[4];
+	uint64_t evals[EVAL_BINS];
+	uint64_t plies[PLIES_BINS];
+	uint64_t plies_total;
+};
+
+/* A range of whole games, read by one thread into its own statistics. */
+struct shard {
+	pthread_t thread;
+	const unsigned char *data;
+	int version;
+	size_t begin;
+	size_t end;
+	struct stats *stats;
+
+	int error;
+	char message[256];
+};
+
+static int result_index(signed char result) {
+	return result == RESULT_WIN ? 0 : result == RESULT_DRAW ? 1 : result == RESULT_LOSS ? 2 : 3;
+}
+
 static void store_information(struct position *pos, uint64_t piece_square[7][64]) {
 	for (int color = 0; color < 2; color++) {
 		for (int piece = PAWN; piece <= KING; piece++) {
@@ -43,148 +91,278 @@ static void store_information(struct position *pos, uint64_t piece_square[7][64]
 	}
 }
 
-static void print_information(uint64_t square[64], uint64_t total) {
-	for (int r = 7; r >= 0; r--) {
-		printf("+-------+-------+-------+-------+-------+-------+-------+-------+\n|");
-		for (int f = 0; f < 8; f++) {
-			int sq = make_square(f, r);
-			printf(" %5.2f |", 100.f * square[sq] / (2 * total));
-		}
-		printf("\n");
-	}
-	printf("+-------+-------+-------+-------+-------+-------+-------+-------+\n");
-	printf("\n");
+/* A game of n positions has n - 1 plies, the first position being the
+ * start of the game.
+ */
+static void store_game(struct stats *stats, signed char result, int positions) {
+	if (!positions)
+		return;
+	int plies = positions - 1;
+	int bin   = plies / PLIES_BIN;
+	stats->games++;
+	stats->results[result_index(result)]++;
+	stats->plies[bin < PLIES_BINS ? bin : PLIES_BINS - 1]++;
+	stats->plies_total += plies;
 }
 
-int main(int argc, char **argv) {
-	if (argc < 2) {
-		printf("provide a filename\n");
-		return 1;
-	}
-	FILE *f = fopen(argv[1], "rb");
-	if (!f) {
-		printf("could not open %s\n", argv[1]);
-		return 2;
-	}
+static void *hist_shard(void *arg) {
+	struct shard *shard       = arg;
+	struct stats *stats       = shard->stats;
+	const unsigned char *data = shard->data;
+	size_t end                = shard->end;
+	size_t offset             = shard->begin;
+	int version               = shard->version;
 
-	magicbitboard_init();
-	attackgen_init();
-	bitboard_init();
-	position_init();
 	struct position pos = { 0 };
-	startpos(&pos);
-
-	uint64_t piece_square[7][64] = { 0 };
-
+	signed char result  = 0;
+	int32_t eval;
 	move_t move;
-	signed char result = 0;
-	int32_t eval       = 0;
-	size_t total       = 0;
-	size_t count       = 0;
-	size_t games       = 0;
-	size_t draws       = 0;
-	char startfen[128] = { 0 };
-	char fen[128];
-	char movestr[16];
-	int print_flag = 0;
 	unsigned char flag;
-	while (1) {
-		count++;
-		if (count % 20000 == 0)
-			printf("collecting data: %lu\r", count);
-		move = 0;
-		if (read_move(f, &move))
-			break;
+	int positions = 0;
+
+	int first = 1;
+	while (offset < end) {
+		if (read_move_mem(data, &move, &offset, end)) {
+			shard->error = 1;
+			return NULL;
+		}
 		if (move) {
-			if (print_flag)
-				printf("%s\n", move_str_pgn(movestr, &pos, &move));
-			print_flag = 0;
+			/* A stale index can start a shard in the middle of a game. */
+			if (first) {
+				sprintf(shard->message, "game without a start at byte offset %zu", offset - 2);
+				shard->error = 1;
+				return NULL;
+			}
 			struct pstate ps;
 			pstate_init(&pos, &ps);
 			if (!pseudo_legal(&pos, &ps, &move) || !legal(&pos, &ps, &move)) {
-				fprintf(stderr, "error: illegal move %s for position %s\n",
-				        move_str_algebraic(movestr, &move), pos_to_fen(fen, &pos));
-				exit(1);
+				char movestr[16], fen[128];
+				sprintf(shard->message, "illegal move %s for position %s", move_str_algebraic(movestr, &move),
+				        pos_to_fen(fen, &pos));
+				shard->error = 1;
+				return NULL;
 			}
 			do_move(&pos, &move);
 		}
 		else {
-			if (read_position(f, &pos))
-				break;
-			if (read_result(f, &result))
-				break;
-			if (!feof(f))
-				games++;
-			pos_to_fen(startfen, &pos);
+			store_game(stats, result, positions);
+			positions = 0;
+			if ((version == 1 ? read_position_mem(data, &pos, &offset, end)
+			                  : read_position2_mem(data, &pos, &offset, end))
+			    || read_result_mem(data, &result, &offset, end)) {
+				shard->error = 1;
+				return NULL;
+			}
 		}
+		first = 0;
+		if ((version == 1 ? read_eval_mem(data, &eval, &offset, end) : read_eval2_mem(data, &eval, &offset, end))
+		    || read_flag_mem(data, &flag, &offset, end)) {
+			shard->error = 1;
+			return NULL;
+		}
+		positions++;
 
-		if (read_eval(f, &eval) || read_flag(f, &flag))
-			break;
-		if (feof(f))
-			break;
-
-		if (eval == VALUE_NONE || flag & FLAG_SKIP)
+		if (eval == VALUE_NONE || flag & FLAG_SKIP) {
+			stats->skipped++;
 			continue;
+		}
+		int white_eval = (2 * pos.turn - 1) * eval;
 		if (popcount(all_pieces(&pos)) < 6
-		    && ((result == RESULT_LOSS && (2 * pos.turn - 1) * eval >= VALUE_WIN)
-		        || (result == RESULT_WIN && (2 * pos.turn - 1) * eval <= -VALUE_WIN))) {
+		    && ((result == RESULT_LOSS && white_eval >= VALUE_WIN)
+		        || (result == RESULT_WIN && white_eval <= -VALUE_WIN))) {
+			flockfile(stdout);
 			print_position(&pos);
 			print_fen(&pos);
 			printf("eval: %d\n", eval);
-			printf("result: %s\n", result == RESULT_DRAW   ? "draw"
-			                       : result == RESULT_LOSS ? "black wins"
-			                       : result == RESULT_WIN  ? "white wins"
-			                                               : "unknown");
-		}
-#if 0
-		const int material_values[] = { 0, 1, 3, 3, 5, 9, 0 };
-		int material[2] = { 0 };
-		for (int color = 0; color < 2; color++) {
-			for (int piece = PAWN; piece < KING; piece++) {
-				uint64_t b = pos.piece[color][piece];
-				material[color] += material_values[piece] * popcount(b);
-			}
+			printf("result: %s\n", result == RESULT_LOSS ? "black wins" : "white wins");
+			funlockfile(stdout);
 		}
 
-#if 0
-		if ((material[WHITE] == 4 && material[BLACK] == 0) ||
-				(material[WHITE] == 0 && material[BLACK] == 4)) {
-			int bitbase = bitbase_KPK_probe(&pos, pos.turn);
-			print_position(&pos);
-			print_fen(&pos);
-			printf("start: %s\n", startfen);
-			printf("bitbase: %d\n", bitbase);
-			printf("eval: %d\n", eval);
+		int bin = (clamp(white_eval, -EVAL_BIN * EVAL_BINS / 2, EVAL_BIN * EVAL_BINS / 2) + EVAL_BIN * EVAL_BINS / 2)
+		        / EVAL_BIN;
+		stats->evals[min(bin, EVAL_BINS - 1)]++;
+		store_information(&pos, stats->piece_square);
+		stats->positions++;
+
+		if (result == RESULT_DRAW)
+			stats->draws++;
+	}
+	store_game(stats, result, positions);
+	return NULL;
+}
+
+/* Splits the file between the threads by the index of its games. */
+static int hist_file(const char *path, struct stats *stats, int jobs) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st)) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		return 2;
+	}
+	size_t size               = st.st_size;
+	const unsigned char *data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "error: failed to map file '%s'\n", path);
+		return 2;
+	}
+
+	int version;
+	size_t begin = 0;
+	struct bitindex bi;
+	if (read_header_mem(data, &version, &begin, size)) {
+		fprintf(stderr, "error: bad header in file '%s'\n", path);
+		munmap((void *)data, size);
+		return 3;
+	}
+	/* Only a file without games can not be indexed. */
+	if (bitindex_load(&bi, path, data, size) && bitindex_build_mem(&bi, data, size)) {
+		if (begin < size)
+			fprintf(stderr, "error: bad training data in file '%s'\n", path);
+		if (data)
+			munmap((void *)data, size);
+		return begin < size ? 3 : 0;
+	}
+
+	size_t games = bi.games_num;
+	if ((size_t)jobs > games)
+		jobs = games;
+
+	struct shard *shards = calloc(jobs, sizeof(*shards));
+	for (int i = 0; i < jobs; i++) {
+		size_t first      = i * games / jobs;
+		size_t last       = (i + 1) * games / jobs;
+		shards[i].data    = data;
+		shards[i].version = version;
+		shards[i].begin   = bi.offsets[first];
+		shards[i].end     = last < games ? bi.offsets[last] : size;
+		shards[i].stats   = &stats[i];
+		pthread_create(&shards[i].thread, NULL, hist_shard, &shards[i]);
+	}
+
+	int ret = 0;
+	for (int i = 0; i < jobs; i++) {
+		pthread_join(shards[i].thread, NULL);
+		if (!ret && shards[i].error) {
+			fprintf(stderr, "error: bad training data in file '%s'", path);
+			if (shards[i].message[0])
+				fprintf(stderr, ": %s", shards[i].message);
+			fprintf(stderr, "\n");
+			ret = 4;
 		}
-#endif
-#if 1
-		int material_delta = abs(material[WHITE] - material[BLACK]);
+	}
 
-		if (material_delta >= 3 && eval == 0 && pos.halfmove <= 0) {
-			print_position(&pos);
-			print_fen(&pos);
-			printf("start: %s\n", startfen);
-			printf("%d\n", (2 * pos.turn - 1) * evaluate_classical(&pos));
-			printf("%d\n", pos.turn ? eval : -eval);
-			print_flag = 1;
-			if (eval == 0)
-				c++;
-			a++;
+	free(shards);
+	bitindex_free(&bi);
+	munmap((void *)data, size);
+	return ret;
+}
+
+static void merge_stats(struct stats *stats, const struct stats *other) {
+	uint64_t *s       = (uint64_t *)stats;
+	const uint64_t *o = (const uint64_t *)other;
+	for (size_t i = 0; i < sizeof(*stats) / sizeof(*s); i++)
+		s[i] += o[i];
+}
+
+static void print_information(const uint64_t square[64], uint64_t total) {
+	for (int r = 7; r >= 0; r--) {
+		printf("+-------+-------+-------+-------+-------+-------+-------+-------+\n|");
+		for (int f = 0; f < 8; f++) {
+			int sq = make_square(f, r);
+			printf(" %5.2f |", 100.f * square[sq] / (2 * total));
 		}
-#endif
-#endif
-		store_information(&pos, piece_square);
-		total++;
+		printf("\n");
+	}
+	printf("+-------+-------+-------+-------+-------+-------+-------+-------+\n");
+	printf("\n");
+}
 
-		if (result == RESULT_DRAW)
-			draws++;
+static void print_stats(const struct stats *stats) {
+	uint64_t total = stats->positions;
+	uint64_t games = stats->games;
+	printf("total positions: %" PRIu64 "\n", total);
+	printf("skipped positions: %" PRIu64 "\n", stats->skipped);
+	printf("total games: %" PRIu64 "\n", games);
+	printf("draw percent: %lg\n", (double)stats->draws / total);
+	printf("\n");
+
+	static const char *result_strings[] = { "white wins", "draws", "black wins", "unknown" };
+	for (int i = 0; i < 4; i++)
+		printf("%-10s: %10" PRIu64 " %6.2f%%\n", result_strings[i], stats->results[i],
+		       100. * stats->results[i] / games);
+	printf("\n");
+
+	printf("plies per game: %lg\n", (double)stats->plies_total / games);
+	for (int i = 0; i < PLIES_BINS; i++) {
+		if (i < PLIES_BINS - 1)
+			printf("%4d-%-4d : ", i * PLIES_BIN, (i + 1) * PLIES_BIN - 1);
+		else
+			printf("%4d+     : ", i * PLIES_BIN);
+		printf("%10" PRIu64 " %6.2f%%\n", stats->plies[i], 100. * stats->plies[i] / games);
 	}
-	printf("\033[2K");
-	printf("total positions: %lu\n", total);
-	printf("total games: %lu\n", games);
-	printf("draw percent: %lg\n", (double)draws / total);
+	printf("\n");
+
+	printf("evaluation from white's point of view:\n");
+	for (int i = 0; i < EVAL_BINS; i++) {
+		printf("%s%5d  : ", i == 0 ? "<=" : i == EVAL_BINS - 1 ? ">=" : "  ", (i - EVAL_BINS / 2) * EVAL_BIN);
+		printf("%10" PRIu64 " %6.2f%%\n", stats->evals[i], 100. * stats->evals[i] / total);
+	}
+	printf("\n");
+
 	for (int piece = PAWN; piece <= KING; piece++)
-		print_information(piece_square[piece], total);
+		print_information(stats->piece_square[piece], total);
+}
+
+int main(int argc, char **argv) {
+	int jobs = 1;
+	static struct option opts[] = {
+		{ "jobs", required_argument, NULL, 'j' },
+		{   NULL,                 0, NULL,   0 },
+	};
+	char *endptr;
+	int c, option_index = 0;
+	int error = 0;
+	while ((c = getopt_long(argc, argv, "j:", opts, &option_index)) != -1) {
+		switch (c) {
+		case 'j':
+			errno = 0;
+			jobs  = strtol(optarg, &endptr, 10);
+			if (errno || *endptr != '\0' || jobs < 1 || jobs > 1024)
+				error = 1;
+			break;
+		default:
+			error = 1;
+			break;
+		}
+	}
+	if (error || optind >= argc) {
+		fprintf(stderr, "usage: %s [--jobs n] file...\n", argv[0]);
+		return 1;
+	}
 
-	fclose(f);
+	magicbitboard_init();
+	attackgen_init();
+	bitboard_init();
+	position_init();
+
+	/* Every thread keeps its own statistics for all files, which are
+	 * merged at the end.
+	 */
+	struct stats *stats = calloc(jobs, sizeof(*stats));
+	if (!stats) {
+		fprintf(stderr, "error: malloc\n");
+		return 1;
+	}
+	int ret = 0;
+	for (int i = optind; i < argc && !ret; i++)
+		ret = hist_file(argv[i], stats, jobs);
+
+	if (!ret) {
+		for (int i = 1; i < jobs; i++)
+			merge_stats(&stats[0], &stats[i]);
+		print_stats(&stats[0]);
+	}
+	free(stats);
+	return ret;
 }
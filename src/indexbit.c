@@ -0,0 +1,105 @@
+/* bitbit, a bitboard based chess engine written in c.
+ * Copyright (C) 2022-2025 Isak Ellmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "io.h"
+
+/* Loads the sidecar of path, or builds and saves it if it is missing, stale
+ * or force is set.
+ */
+static int index_file(struct bitindex *bi, const char *path, int force) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		return 1;
+	}
+	struct stat st;
+	if (fstat(fd, &st)) {
+		fprintf(stderr, "error: failed to stat file '%s'\n", path);
+		close(fd);
+		return 1;
+	}
+	void *map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "error: failed to map file '%s'\n", path);
+		return 1;
+	}
+	if (!force && !bitindex_load(bi, path, map, st.st_size)) {
+		munmap(map, st.st_size);
+		return 0;
+	}
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	int error = bitindex_build_mem(bi, map, st.st_size);
+	munmap(map, st.st_size);
+	if (error) {
+		fprintf(stderr, "error: bad training data in file '%s'\n", path);
+		bitindex_free(bi);
+		return 1;
+	}
+	if (bitindex_save(bi, path)) {
+		fprintf(stderr, "error: failed to write index of file '%s'\n", path);
+		bitindex_free(bi);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int force = 0;
+	int i     = 1;
+	if (argc > 1 && !strcmp(argv[1], "--force")) {
+		force = 1;
+		i     = 2;
+	}
+	if (i >= argc) {
+		fprintf(stderr, "usage: %s [--force] file...\n", argv[0]);
+		return 1;
+	}
+
+	size_t games = 0, positions = 0, results[4] = { 0 };
+	for (; i < argc; i++) {
+		struct bitindex bi;
+		if (index_file(&bi, argv[i], force))
+			return 2;
+		for (size_t k = 0; k < bi.games_num; k++) {
+			int result = bi.results[k];
+			if (result < RESULT_LOSS || result > RESULT_UNKNOWN)
+				result = RESULT_UNKNOWN;
+			positions += bi.plies[k];
+			results[result - RESULT_LOSS]++;
+		}
+		games += bi.games_num;
+		bitindex_free(&bi);
+	}
+
+	printf("games: %lu\n", games);
+	printf("positions: %lu\n", positions);
+	printf("positions per game: %lg\n", (double)positions / games);
+	printf("white wins: %lu\n", results[RESULT_WIN - RESULT_LOSS]);
+	printf("draws: %lu\n", results[RESULT_DRAW - RESULT_LOSS]);
+	printf("black wins: %lu\n", results[RESULT_LOSS - RESULT_LOSS]);
+	printf("unknown: %lu\n", results[RESULT_UNKNOWN - RESULT_LOSS]);
+	return 0;
+}
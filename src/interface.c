@@ -401,10 +401,7 @@ static int interface_ucinewgame(int argc, char **argv) {
 }
 
 static int interface_bench(int argc, char **argv) {
-	UNUSED(argc);
-	UNUSED(argv);
-	bench(&tt);
-	return DONE;
+	return bench(argc, argv, &tt);
 }
 
 static int next_char(int argc, char **argv) {
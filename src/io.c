@@ -14,12 +14,54 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include "io.h"
 
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "bitboard.h"
 
+int write_header(FILE *f, int version) {
+	if (version == 1)
+		return 0;
+	unsigned char buf[BIT_HEADER_SIZE] = BIT_MAGIC;
+	buf[BIT_HEADER_SIZE - 1]           = version;
+	return fwrite(buf, 1, BIT_HEADER_SIZE, f) != BIT_HEADER_SIZE;
+}
+
+static int parse_header(const unsigned char *buf, size_t size, int *version) {
+	*version = 1;
+	if (size < BIT_HEADER_SIZE || memcmp(buf, BIT_MAGIC, sizeof(BIT_MAGIC)))
+		return 0;
+	*version = buf[BIT_HEADER_SIZE - 1];
+	return *version < 2 || *version > BIT_VERSION ? -1 : BIT_HEADER_SIZE;
+}
+
+/* Files without a header are of version 1 and are left at the same offset.
+ * Requires a seekable file.
+ */
+int read_header(FILE *f, int *version) {
+	unsigned char buf[BIT_HEADER_SIZE];
+	size_t r = fread(buf, 1, BIT_HEADER_SIZE, f);
+	int n    = parse_header(buf, r, version);
+	if (n < 0)
+		return 1;
+	clearerr(f);
+	return fseek(f, (long)n - (long)r, SEEK_CUR) != 0;
+}
+
+int read_header_mem(const unsigned char *data, int *version, size_t *index, size_t size) {
+	if (*index > size)
+		return 1;
+	int n = parse_header(data + *index, size - *index, version);
+	if (n < 0)
+		return 1;
+	*index += n;
+	return 0;
+}
+
 int write_uintx(FILE *f, uint64_t p, size_t x) {
 	uint8_t buf[8];
 	switch (x) {
@@ -76,9 +118,13 @@ int read_uintx(FILE *f, void *p, size_t x) {
 	return 0;
 }
 
-int write_position(FILE *f, const struct position *pos) {
-	uint8_t buf[62] = { ctz(pos->piece[WHITE][KING]), ctz(pos->piece[BLACK][KING]) };
-	int index       = 2, sq;
+#define POSITION_SIZE 68
+
+static size_t encode_position(unsigned char *buf, const struct position *pos) {
+	memset(buf, 0, POSITION_SIZE);
+	buf[0]    = ctz(pos->piece[WHITE][KING]);
+	buf[1]    = ctz(pos->piece[BLACK][KING]);
+	int index = 2, sq;
 	uint64_t b;
 
 	for (int turn = 0; turn < 2; turn++) {
@@ -95,19 +141,18 @@ int write_position(FILE *f, const struct position *pos) {
 			}
 		}
 	}
-	if (fwrite(buf, 1, 62, f) != 62)
-		return 1;
-	if (write_uintx(f, pos->turn ? 1 : 0, 1))
-		return 1;
-	if (write_uintx(f, 0 <= pos->en_passant ? pos->en_passant : 64, 1))
-		return 1;
-	if (write_uintx(f, pos->castle, 1))
-		return 1;
-	if (write_uintx(f, pos->halfmove, 1))
-		return 1;
-	if (write_uintx(f, pos->fullmove, 2))
-		return 1;
-	return 0;
+	buf[62] = pos->turn ? 1 : 0;
+	buf[63] = 0 <= pos->en_passant ? pos->en_passant : 64;
+	buf[64] = pos->castle;
+	buf[65] = pos->halfmove;
+	buf[66] = pos->fullmove;
+	buf[67] = pos->fullmove >> 8;
+	return POSITION_SIZE;
+}
+
+int write_position(FILE *f, const struct position *pos) {
+	unsigned char buf[POSITION_SIZE];
+	return fwrite(buf, 1, encode_position(buf, pos), f) != POSITION_SIZE;
 }
 
 int read_position(FILE *f, struct position *pos) {
@@ -116,6 +161,8 @@ int read_position(FILE *f, struct position *pos) {
 		return 1;
 	if (!pos)
 		return 0;
+	if (buf[0] >= 64 || buf[1] >= 64)
+		return 1;
 	memset(pos->piece, 0, sizeof(pos->piece));
 	memset(pos->mailbox, 0, sizeof(pos->mailbox));
 
@@ -132,6 +179,8 @@ int read_position(FILE *f, struct position *pos) {
 		int piece                 = uncolored_piece(cpiece);
 		int color                 = color_of_piece(cpiece);
 		int sq                    = buf[index++];
+		if (cpiece > BLACK_KING || piece == KING || sq >= 64)
+			return 1;
 
 		pos->piece[color][piece] |= bitboard(sq);
 		pos->piece[color][ALL]   |= pos->piece[color][piece];
@@ -161,6 +210,92 @@ int read_position(FILE *f, struct position *pos) {
 	return 0;
 }
 
+/* The occupancy bitboard, at most 32 pieces packed two per byte, turn and
+ * castle, en passant, halfmove and fullmove.
+ */
+#define POSITION2_SIZE_MAX (8 + 16 + 5)
+
+static inline size_t position2_size(const unsigned char *buf) {
+	uint64_t occupied = 0;
+	for (int i = 0; i < 8; i++)
+		occupied |= (uint64_t)buf[i] << (8 * i);
+	return 8 + (popcount(occupied) + 1) / 2 + 5;
+}
+
+static int decode_position2(const unsigned char *buf, struct position *pos) {
+	uint64_t occupied = 0;
+	for (int i = 0; i < 8; i++)
+		occupied |= (uint64_t)buf[i] << (8 * i);
+	if (popcount(occupied) > 32)
+		return 1;
+
+	struct position t;
+	if (!pos)
+		pos = &t;
+	memset(pos->piece, 0, sizeof(pos->piece));
+	memset(pos->mailbox, 0, sizeof(pos->mailbox));
+
+	const unsigned char *pieces = buf + 8;
+	for (int i = 0; occupied; i++, occupied = clear_ls1b(occupied)) {
+		int sq     = ctz(occupied);
+		int cpiece = (pieces[i / 2] >> (4 * (i % 2))) & 0xF;
+		if (cpiece < WHITE_PAWN || cpiece > BLACK_KING)
+			return 1;
+		int piece                 = uncolored_piece(cpiece);
+		int color                 = color_of_piece(cpiece);
+
+		pos->piece[color][piece] |= bitboard(sq);
+		pos->piece[color][ALL]   |= bitboard(sq);
+		pos->mailbox[sq]          = cpiece;
+	}
+	if (popcount(pos->piece[WHITE][KING]) != 1 || popcount(pos->piece[BLACK][KING]) != 1)
+		return 1;
+
+	const unsigned char *state = buf + position2_size(buf) - 5;
+	pos->turn                  = state[0] & 0x1;
+	pos->castle                = state[0] >> 1;
+	pos->en_passant            = state[1] < 64 ? state[1] : 0;
+	pos->halfmove              = state[2];
+	pos->fullmove              = (uint16_t)state[3] | (uint16_t)state[4] << 8;
+	return 0;
+}
+
+static size_t encode_position2(unsigned char *buf, const struct position *pos) {
+	memset(buf, 0, POSITION2_SIZE_MAX);
+	uint64_t occupied = pos->piece[WHITE][ALL] | pos->piece[BLACK][ALL];
+	for (int i = 0; i < 8; i++)
+		buf[i] = occupied >> (8 * i);
+
+	int i = 0;
+	for (uint64_t b = occupied; b && i < 32; b = clear_ls1b(b), i++)
+		buf[8 + i / 2] |= pos->mailbox[ctz(b)] << (4 * (i % 2));
+
+	size_t size          = position2_size(buf);
+	unsigned char *state = buf + size - 5;
+	state[0]             = (pos->turn ? 1 : 0) | pos->castle << 1;
+	state[1]             = 0 <= pos->en_passant ? pos->en_passant : 0;
+	state[2]             = pos->halfmove;
+	state[3]             = pos->fullmove;
+	state[4]             = pos->fullmove >> 8;
+	return size;
+}
+
+int write_position2(FILE *f, const struct position *pos) {
+	unsigned char buf[POSITION2_SIZE_MAX];
+	size_t size = encode_position2(buf, pos);
+	return fwrite(buf, 1, size, f) != size;
+}
+
+int read_position2(FILE *f, struct position *pos) {
+	unsigned char buf[POSITION2_SIZE_MAX];
+	if (fread(buf, 1, 8, f) != 8)
+		return 1;
+	size_t size = position2_size(buf);
+	if (size > POSITION2_SIZE_MAX || fread(buf + 8, 1, size - 8, f) != size - 8)
+		return 1;
+	return decode_position2(buf, pos);
+}
+
 int write_move(FILE *f, move_t move) { return write_uintx(f, move, 2); }
 
 int read_move(FILE *f, move_t *move) {
@@ -188,6 +323,43 @@ int read_eval(FILE *f, int32_t *eval) {
 	return 0;
 }
 
+/* Zigzag encoded with 7 bits per byte, least significant first. The high bit
+ * of every byte but the last is set.
+ */
+static size_t encode_eval2(unsigned char *buf, int32_t eval) {
+	uint32_t u  = eval >= 0 ? 2 * (uint32_t)eval : 2 * (uint32_t)-(eval + 1) + 1;
+	size_t size = 0;
+	do {
+		buf[size++] = (u & 0x7F) | (u > 0x7F ? 0x80 : 0);
+		u         >>= 7;
+	} while (u);
+	return size;
+}
+
+int write_eval2(FILE *f, int32_t eval) {
+	unsigned char buf[5];
+	size_t size = encode_eval2(buf, eval);
+	return fwrite(buf, 1, size, f) != size;
+}
+
+static inline int32_t unzigzag(uint32_t u) { return u & 1 ? -(int32_t)(u >> 1) - 1 : (int32_t)(u >> 1); }
+
+int read_eval2(FILE *f, int32_t *eval) {
+	uint32_t u = 0;
+	for (int i = 0; i < 5; i++) {
+		int c = fgetc(f);
+		if (c == EOF)
+			return 1;
+		u |= (uint32_t)(c & 0x7F) << (7 * i);
+		if (!(c & 0x80)) {
+			if (eval)
+				*eval = unzigzag(u);
+			return 0;
+		}
+	}
+	return 1;
+}
+
 int write_result(FILE *f, signed char result) { return write_uintx(f, result, 1); }
 
 int read_result(FILE *f, signed char *result) { return read_uintx(f, result, 1); }
@@ -195,3 +367,340 @@ int read_result(FILE *f, signed char *result) { return read_uintx(f, result, 1);
 int write_flag(FILE *f, unsigned char flag) { return write_uintx(f, flag, 1); }
 
 int read_flag(FILE *f, unsigned char *flag) { return read_uintx(f, flag, 1); }
+
+static int read_uintx_mem(const unsigned char *data, void *p, size_t x, size_t *index, size_t size) {
+	if (*index > size || size - *index < x)
+		return 1;
+	const unsigned char *buf = data + *index;
+	*index                  += x;
+	if (!p)
+		return 0;
+	switch (x) {
+	case 1:
+		*(uint8_t *)p = buf[0];
+		break;
+	case 2:
+		*(uint16_t *)p = (uint16_t)buf[0] | (uint16_t)buf[1] << 8;
+		break;
+	default:
+		return 1;
+	}
+	return 0;
+}
+
+int read_position_mem(const unsigned char *data, struct position *pos, size_t *index, size_t size) {
+	/* 62 bytes of pieces followed by turn, en passant, castle, halfmove and
+	 * fullmove.
+	 */
+	if (*index > size || size - *index < 68)
+		return 1;
+	const unsigned char *buf = data + *index;
+	*index                  += 68;
+	if (!pos)
+		return 0;
+	/* The data may come from an offset in an untrusted sidecar, so never
+	 * index the mailbox with a byte that is not a square.
+	 */
+	if (buf[0] >= 64 || buf[1] >= 64)
+		return 1;
+	memset(pos->piece, 0, sizeof(pos->piece));
+	memset(pos->mailbox, 0, sizeof(pos->mailbox));
+
+	pos->piece[WHITE][ALL] = pos->piece[WHITE][KING] = bitboard(buf[0]);
+	pos->piece[BLACK][ALL] = pos->piece[BLACK][KING] = bitboard(buf[1]);
+
+	pos->mailbox[buf[0]]                             = WHITE_KING;
+	pos->mailbox[buf[1]]                             = BLACK_KING;
+
+	for (int i = 2; i <= 62 - 2;) {
+		int cpiece = buf[i++];
+		if (!cpiece)
+			break;
+		int piece                 = uncolored_piece(cpiece);
+		int color                 = color_of_piece(cpiece);
+		int sq                    = buf[i++];
+		if (cpiece > BLACK_KING || piece == KING || sq >= 64)
+			return 1;
+
+		pos->piece[color][piece] |= bitboard(sq);
+		pos->piece[color][ALL]   |= pos->piece[color][piece];
+		pos->mailbox[sq]          = cpiece;
+	}
+
+	pos->turn       = buf[62];
+	pos->en_passant = buf[63] < 64 ? buf[63] : 0;
+	pos->castle     = buf[64];
+	pos->halfmove   = buf[65];
+	pos->fullmove   = (uint16_t)buf[66] | (uint16_t)buf[67] << 8;
+	return 0;
+}
+
+int read_position2_mem(const unsigned char *data, struct position *pos, size_t *index, size_t size) {
+	if (*index > size || size - *index < 8)
+		return 1;
+	const unsigned char *buf = data + *index;
+	size_t n                 = position2_size(buf);
+	if (n > POSITION2_SIZE_MAX || size - *index < n)
+		return 1;
+	*index += n;
+	return decode_position2(buf, pos);
+}
+
+int read_move_mem(const unsigned char *data, move_t *move, size_t *index, size_t size) {
+	uint16_t temp;
+	if (read_uintx_mem(data, &temp, 2, index, size))
+		return 1;
+	if (move)
+		*move = temp;
+	return 0;
+}
+
+int read_eval_mem(const unsigned char *data, int32_t *eval, size_t *index, size_t size) {
+	union {
+		int16_t eval;
+		uint16_t ueval;
+	} t;
+	if (read_uintx_mem(data, &t.ueval, 2, index, size))
+		return 1;
+
+	if (eval)
+		*eval = t.eval;
+	return 0;
+}
+
+int read_eval2_mem(const unsigned char *data, int32_t *eval, size_t *index, size_t size) {
+	uint32_t u = 0;
+	for (int i = 0; i < 5 && *index < size; i++) {
+		unsigned char c = data[(*index)++];
+		u              |= (uint32_t)(c & 0x7F) << (7 * i);
+		if (!(c & 0x80)) {
+			if (eval)
+				*eval = unzigzag(u);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int read_result_mem(const unsigned char *data, signed char *result, size_t *index, size_t size) {
+	return read_uintx_mem(data, result, 1, index, size);
+}
+
+int read_flag_mem(const unsigned char *data, unsigned char *flag, size_t *index, size_t size) {
+	return read_uintx_mem(data, flag, 1, index, size);
+}
+
+static void bitindex_push(struct bitindex *bi, size_t *games_size, uint64_t offset, signed char result) {
+	if (bi->games_num == *games_size) {
+		*games_size = *games_size ? 2 * *games_size : 1024;
+		bi->offsets = realloc(bi->offsets, *games_size * sizeof(*bi->offsets));
+		bi->plies   = realloc(bi->plies, *games_size * sizeof(*bi->plies));
+		bi->results = realloc(bi->results, *games_size * sizeof(*bi->results));
+	}
+	bi->offsets[bi->games_num] = offset;
+	bi->plies[bi->games_num]   = 0;
+	bi->results[bi->games_num] = result;
+	bi->games_num++;
+}
+
+/* Verifies that data consists of whole records of at least one game, so that
+ * the games can be decoded without any further checks.
+ */
+int bitindex_build_mem(struct bitindex *bi, const unsigned char *data, size_t size) {
+	memset(bi, 0, sizeof(*bi));
+	bi->size          = size;
+	size_t games_size = 0;
+	size_t offset     = 0;
+	move_t move;
+	signed char result;
+
+	if (read_header_mem(data, &bi->version, &offset, size))
+		return 1;
+	int version = bi->version;
+	while (offset < size) {
+		size_t start = offset;
+		if (read_move_mem(data, &move, &offset, size))
+			return 1;
+		if (!move) {
+			if ((version == 1 ? read_position_mem(data, NULL, &offset, size)
+			                  : read_position2_mem(data, NULL, &offset, size))
+			    || read_result_mem(data, &result, &offset, size))
+				return 1;
+			bitindex_push(bi, &games_size, start, result);
+		}
+		else if (!bi->games_num) {
+			return 1;
+		}
+		if ((version == 1 ? read_eval_mem(data, NULL, &offset, size) : read_eval2_mem(data, NULL, &offset, size))
+		    || read_flag_mem(data, NULL, &offset, size))
+			return 1;
+		bi->plies[bi->games_num - 1]++;
+	}
+	return !bi->games_num;
+}
+
+/* The inode and the modification time in nanoseconds of path. */
+static int bitindex_stat(const char *path, uint64_t *inode, uint64_t *mtime) {
+	struct stat st;
+	if (stat(path, &st))
+		return 1;
+	*inode = st.st_ino;
+	*mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	return 0;
+}
+
+static char *bitindex_path(const char *path) {
+	char *str = malloc(strlen(path) + 5);
+	if (str)
+		sprintf(str, "%s.idx", path);
+	return str;
+}
+
+int bitindex_save(const struct bitindex *bi, const char *path) {
+	uint64_t inode, mtime;
+	if (bitindex_stat(path, &inode, &mtime))
+		return 1;
+	char *str = bitindex_path(path);
+	FILE *f   = str ? fopen(str, "wb") : NULL;
+	free(str);
+	if (!f)
+		return 1;
+
+	unsigned char magic[8] = BITINDEX_MAGIC;
+
+	int error = fwrite(magic, 1, sizeof(magic), f) != sizeof(magic) || write_uintx(f, bi->size, 8)
+	         || write_uintx(f, bi->version, 1) || write_uintx(f, inode, 8) || write_uintx(f, mtime, 8)
+	         || write_uintx(f, bi->games_num, 8);
+	for (size_t i = 0; i < bi->games_num && !error; i++)
+		error = write_uintx(f, bi->offsets[i], 8) || write_uintx(f, bi->plies[i], 4)
+		     || write_uintx(f, bi->results[i], 1);
+	return fclose(f) || error;
+}
+
+/* Loads the sidecar of the .bit file path, mapped at data. The sidecar has to
+ * have been saved for this very file and every offset has to point to the
+ * start of a game of data, or it is rejected.
+ */
+int bitindex_load(struct bitindex *bi, const char *path, const unsigned char *data, uint64_t size) {
+	memset(bi, 0, sizeof(*bi));
+	int data_version;
+	size_t begin = 0;
+	uint64_t inode, mtime;
+	if (read_header_mem(data, &data_version, &begin, size) || bitindex_stat(path, &inode, &mtime))
+		return 1;
+	char *str = bitindex_path(path);
+	FILE *f   = str ? fopen(str, "rb") : NULL;
+	free(str);
+	if (!f)
+		return 1;
+
+	unsigned char magic[8];
+	uint8_t version;
+	uint64_t games_num, index_inode, index_mtime;
+	int error = fread(magic, 1, sizeof(magic), f) != sizeof(magic)
+	         || memcmp(magic, BITINDEX_MAGIC, sizeof(BITINDEX_MAGIC)) || read_uintx(f, &bi->size, 8)
+	         || bi->size != size || read_uintx(f, &version, 1) || version != data_version
+	         || read_uintx(f, &index_inode, 8) || index_inode != inode || read_uintx(f, &index_mtime, 8)
+	         || index_mtime != mtime || read_uintx(f, &games_num, 8) || !games_num || games_num > size;
+	if (!error) {
+		bi->version   = version;
+		bi->games_num = games_num;
+		bi->offsets   = malloc(games_num * sizeof(*bi->offsets));
+		bi->plies     = malloc(games_num * sizeof(*bi->plies));
+		bi->results   = malloc(games_num * sizeof(*bi->results));
+		error         = !bi->offsets || !bi->plies || !bi->results;
+	}
+	for (size_t i = 0; i < bi->games_num && !error; i++)
+		error = read_uintx(f, &bi->offsets[i], 8) || read_uintx(f, &bi->plies[i], 4)
+		     || read_uintx(f, &bi->results[i], 1) || bi->offsets[i] + 2 > size
+		     || (i > 0 ? bi->offsets[i] <= bi->offsets[i - 1] : bi->offsets[i] != begin)
+		     || data[bi->offsets[i]] || data[bi->offsets[i] + 1];
+	fclose(f);
+	if (error)
+		bitindex_free(bi);
+	return error;
+}
+
+void bitindex_free(struct bitindex *bi) {
+	free(bi->offsets);
+	free(bi->plies);
+	free(bi->results);
+	memset(bi, 0, sizeof(*bi));
+}
+
+int bitwriter_open(struct bitwriter *w, const char *path, int version) {
+	memset(w, 0, sizeof(*w));
+	w->version = version;
+	if (!(w->f = fopen(path, "wb")))
+		return 1;
+	/* Only whole chunks are written, straight from the buffer. */
+	setvbuf(w->f, NULL, _IONBF, 0);
+	w->capacity = 2 * BITWRITER_CHUNK;
+	if (!(w->buf = malloc(w->capacity))) {
+		fclose(w->f);
+		return 1;
+	}
+	if (version != 1) {
+		memcpy(w->buf, BIT_MAGIC, sizeof(BIT_MAGIC));
+		w->buf[BIT_HEADER_SIZE - 1] = version;
+		w->len = w->size = BIT_HEADER_SIZE;
+	}
+	return 0;
+}
+
+static int bitwriter_flush(struct bitwriter *w, size_t n) {
+	if (n && fwrite(w->buf, 1, n, w->f) != n)
+		w->error = 1;
+	memmove(w->buf, w->buf + n, w->len - n);
+	w->len -= n;
+	return w->error;
+}
+
+int bitwriter_game(struct bitwriter *w, const struct position *start, signed char result, int ply,
+                   const move_t *moves, const int32_t *evals, const unsigned char *flags) {
+	size_t needed = 2 + POSITION_SIZE + 1 + 8 * ((size_t)ply + 1);
+	if (w->len + needed > w->capacity) {
+		size_t capacity = w->capacity;
+		while (w->len + needed > capacity)
+			capacity *= 2;
+		unsigned char *buf = realloc(w->buf, capacity);
+		if (!buf)
+			return w->error = 1;
+		w->buf      = buf;
+		w->capacity = capacity;
+	}
+
+	unsigned char *p = w->buf + w->len;
+	*p++             = 0;
+	*p++             = 0;
+	p               += w->version == 1 ? encode_position(p, start) : encode_position2(p, start);
+	*p++             = result;
+	for (int i = 0; i <= ply; i++) {
+		if (w->version == 1) {
+			*p++ = evals[i];
+			*p++ = evals[i] >> 8;
+		}
+		else {
+			p += encode_eval2(p, evals[i]);
+		}
+		*p++ = flags[i];
+		if (i < ply) {
+			*p++ = moves[i];
+			*p++ = moves[i] >> 8;
+		}
+	}
+
+	size_t n  = p - (w->buf + w->len);
+	w->len   += n;
+	w->size  += n;
+	w->games++;
+	return w->len >= BITWRITER_CHUNK ? bitwriter_flush(w, w->len - w->len % BITWRITER_CHUNK) : w->error;
+}
+
+int bitwriter_close(struct bitwriter *w) {
+	bitwriter_flush(w, w->len);
+	int error = fclose(w->f) || w->error;
+	free(w->buf);
+	memset(w, 0, sizeof(*w));
+	return error;
+}
@@ -14,8 +14,13 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "kpk.h"
+
 #include <stdint.h>
 
-const uint32_t bitbase_KPK[12288] = {
+const uint32_t bitbase_KPK[] = {
 #include "../etc/kpk.bin"
 };
+
+_Static_assert(sizeof(bitbase_KPK) == (BITBASE_KPK_BLOCKS + BITBASE_KPK_RUN_ENTRIES) * sizeof(*bitbase_KPK),
+               "etc/kpk.bin does not match the format of kpk.h, regenerate it with basebit");
@@ -14,8 +14,13 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "kpkp.h"
+
 #include <stdint.h>
 
-const uint32_t bitbase_KPKP[294912] = {
+const uint32_t bitbase_KPKP[] = {
 #include "../etc/kpkp.bin"
 };
+
+_Static_assert(sizeof(bitbase_KPKP) == (BITBASE_KPKP_BLOCKS + BITBASE_KPKP_RUN_ENTRIES) * sizeof(*bitbase_KPKP),
+               "etc/kpkp.bin does not match the format of kpkp.h, regenerate it with basebit");
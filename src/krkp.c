@@ -14,8 +14,13 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "krkp.h"
+
 #include <stdint.h>
 
-const uint32_t bitbase_KRKP[786432] = {
+const uint32_t bitbase_KRKP[] = {
 #include "../etc/krkp.bin"
 };
+
+_Static_assert(sizeof(bitbase_KRKP) == (BITBASE_KRKP_BLOCKS + BITBASE_KRKP_RUN_ENTRIES) * sizeof(*bitbase_KRKP),
+               "etc/krkp.bin does not match the format of krkp.h, regenerate it with basebit");
@@ -34,7 +34,7 @@ uint64_t rook_attacks_lookup[102400];
 struct magic bishop_magic[64];
 struct magic rook_magic[64];
 
-static uint64_t bishop_attacks_calc(int square, uint64_t b) {
+uint64_t bishop_attacks_calc(int square, uint64_t b) {
 	uint64_t attacks = 0;
 	int x            = file_of(square);
 	int y            = rank_of(square);
@@ -70,7 +70,7 @@ static uint64_t bishop_attacks_calc(int square, uint64_t b) {
 	return attacks;
 }
 
-static uint64_t rook_attacks_calc(int square, uint64_t b) {
+uint64_t rook_attacks_calc(int square, uint64_t b) {
 	uint64_t attacks = 0;
 	int x            = file_of(square);
 	int y            = rank_of(square);
@@ -202,25 +202,60 @@ uint64_t rook_full_mask_calc(int square) {
 	return mask;
 }
 
-static void magic_calc(int square, int piece) {
-	struct magic *magic = piece == ROOK ? &rook_magic[square] : &bishop_magic[square];
+/* The magic numbers that magic_find finds with the seeds below. Searching
+ * for them takes most of the startup time, so they are stored here instead.
+ */
+static const uint64_t bishop_magics[64] = {
+	0x8402200802004844, 0x500238061404c200, 0x0029422202014000, 0x00080a082401000e,
+	0x11c1104100000100, 0x0004901028000000, 0x082e150920100004, 0x000201809c104a00,
+	0x000008a00800810a, 0x020008100d005502, 0x0000190802088000, 0x0200880a04220100,
+	0x8000040420005100, 0x8040011008042002, 0x0400205414203828, 0x4004090108020290,
+	0x0240468450021224, 0x0084051010021040, 0x30100d4840802100, 0x081400109022000d,
+	0x8044000880a08000, 0x0000811808110830, 0x1400400424022800, 0x0100800200840110,
+	0x00221043c0101280, 0x0005300104a42820, 0x0408080101104101, 0x0005080004004110,
+	0x0810030010200800, 0x480040408a011000, 0x8002a180030c1000, 0x0240720010808400,
+	0x2481206000104400, 0x0031040229501010, 0x8000231001090c00, 0x10200808002e0a00,
+	0x1041300400008020, 0x0002080201811041, 0x0819080880911430, 0x1824010020020880,
+	0x0a00907010a80801, 0x0900580410a40400, 0x500201040a001101, 0x0016182018002100,
+	0x00042000a2800401, 0x2220081000200044, 0x3034084801240040, 0x30100d4840802100,
+	0x082e150920100004, 0x000201809c104a00, 0x020000420090044a, 0xc000020104880000,
+	0x0082000810340802, 0x1001200441020802, 0x030818280c8c0008, 0x500238061404c200,
+	0x000201809c104a00, 0x4004090108020290, 0x2570020704112404, 0x084c428000208801,
+	0x0112016111820201, 0x0412804244080080, 0x000008a00800810a, 0x8402200802004844,
+};
+
+static const uint64_t rook_magics[64] = {
+	0x0080085020814000, 0x8040004020001002, 0x0200084200108020, 0x0880080104811000,
+	0x2200040200100820, 0x4400840050020820, 0x8400024400911810, 0x02001362820401c1,
+	0x1058800080400020, 0x0040404000201000, 0x3160801000802000, 0x4492000820144200,
+	0x200180800c000800, 0x0002000200040810, 0x0614006421104e28, 0xc001000200408100,
+	0x0600248000400082, 0x0040404000201000, 0x0008110020010044, 0x0048010100100020,
+	0x0031010008001004, 0x0011010006588c00, 0x08281c0009020890, 0x010a020010810844,
+	0x2020800080204000, 0x0240006120100800, 0x4800900680200080, 0x0848008880100180,
+	0x8004008080040802, 0x0002000200040810, 0x0000088400302122, 0x0043004a00108104,
+	0x5000824002800020, 0x0800802000804000, 0x0180104101002000, 0x0120100101000820,
+	0x8000310025000800, 0x4112002004040010, 0x0402020104000810, 0x0040004102000084,
+	0x0028400088218000, 0x0010004020014002, 0x0008110020010044, 0x0008080010008080,
+	0x0021000800050010, 0x0302001004020008, 0x0030100201040008, 0x20aa040090420011,
+	0x0020208a05044a00, 0x0020208a05044a00, 0x0108802200104200, 0x0008080010008080,
+	0x0002001004210a00, 0x8120800400020080, 0x4000800100020080, 0xc001000200408100,
+	0x4000130021c88001, 0x10c2010080401022, 0x80a0021241082101, 0x6000081000200501,
+	0x0102001008200402, 0x0002005350440802, 0x0000008102081004, 0x0000d02144048302,
+};
+
+uint64_t magic_find(int square, int piece) {
+	uint64_t mask  = piece == ROOK ? rook_mask_calc(square) : bishop_mask_calc(square);
+	unsigned shift = 64 - popcount(mask);
+
 	uint64_t occ[4096];
 	uint64_t attacks[4096];
+	uint64_t table[4096];
 	int epochs[4096]  = { 0 };
 
-	magic->mask       = piece == ROOK ? rook_mask_calc(square) : bishop_mask_calc(square);
-	magic->shift      = 64 - popcount(magic->mask);
-
 	uint64_t seeds[2] = { 5273, 23293 };
 
 	uint64_t seed     = seeds[piece == ROOK];
 
-	if (square == a1)
-		magic->attacks = piece == ROOK ? rook_attacks_lookup : bishop_attacks_lookup;
-
-	if (square < h8)
-		(magic + 1)->attacks = magic->attacks + (1 << popcount(magic->mask));
-
 	/* <https://www.chessprogramming.org/Traversing_Subsets_of_a_Set> */
 	uint64_t b = 0;
 	int size   = 0;
@@ -228,41 +263,63 @@ static void magic_calc(int square, int piece) {
 		occ[size]     = b;
 		attacks[size] = piece == ROOK ? rook_attacks_calc(square, b) : bishop_attacks_calc(square, b);
 
-#ifdef PEXT
-		magic->attacks[_pext_u64(b, magic->mask)] = attacks[size];
-#endif
-
-		b = (b - magic->mask) & magic->mask;
+		b = (b - mask) & mask;
 		size++;
 	}
 	while (b);
 
-#ifdef PEXT
-	return;
-#endif
-
+	uint64_t magic;
 	int epoch, j = 0;
 	for (epoch = 1; j != size; epoch++) {
-		magic->magic = xorshift64(&seed) & xorshift64(&seed) & xorshift64(&seed);
+		magic = xorshift64(&seed) & xorshift64(&seed) & xorshift64(&seed);
 
-		if (popcount((magic->mask * magic->magic) >> 56) < 6)
+		if (popcount((mask * magic) >> 56) < 6)
 			continue;
 
 		for (j = 0; j < size; j++) {
-			int k = (occ[j] * magic->magic) >> magic->shift;
+			int k = (occ[j] * magic) >> shift;
 
 			/* If what we stored at k is from the previous epoch, we are
 			 * safe to restore, otherwise we already stored something
 			 * this epoch and this is not a proper magic number.
 			 */
 			if (epochs[k] < epoch) {
-				epochs[k]         = epoch;
-				magic->attacks[k] = attacks[j];
+				epochs[k] = epoch;
+				table[k]  = attacks[j];
 			}
-			else if (magic->attacks[k] != attacks[j])
+			else if (table[k] != attacks[j])
 				break;
 		}
 	}
+
+	return magic;
+}
+
+static void magic_calc(int square, int piece) {
+	struct magic *magic = piece == ROOK ? &rook_magic[square] : &bishop_magic[square];
+
+	magic->mask         = piece == ROOK ? rook_mask_calc(square) : bishop_mask_calc(square);
+	magic->shift        = 64 - popcount(magic->mask);
+	magic->magic        = piece == ROOK ? rook_magics[square] : bishop_magics[square];
+
+	if (square == a1)
+		magic->attacks = piece == ROOK ? rook_attacks_lookup : bishop_attacks_lookup;
+
+	if (square < h8)
+		(magic + 1)->attacks = magic->attacks + (1 << popcount(magic->mask));
+
+	uint64_t b = 0;
+	do {
+		uint64_t attacks = piece == ROOK ? rook_attacks_calc(square, b) : bishop_attacks_calc(square, b);
+#ifdef PEXT
+		magic->attacks[_pext_u64(b, magic->mask)] = attacks;
+#else
+		magic->attacks[(b * magic->magic) >> magic->shift] = attacks;
+#endif
+
+		b = (b - magic->mask) & magic->mask;
+	}
+	while (b);
 }
 
 void magicbitboard_init(void) {
@@ -0,0 +1,409 @@
+/* bitbit, a bitboard based chess engine written in c.
+ * Copyright (C) 2022-2025 Isak Ellmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "attackgen.h"
+#include "bench.h"
+#include "bitboard.h"
+#include "endgame.h"
+#include "history.h"
+#include "magicbitboard.h"
+#include "move.h"
+#include "movegen.h"
+#include "moveorder.h"
+#include "nnue.h"
+#include "option.h"
+#include "position.h"
+#include "search.h"
+#include "timeman.h"
+#include "transposition.h"
+#include "util.h"
+
+/* Every primitive is measured on the positions of the bench and on the
+ * positions reachable by one legal move from them.
+ */
+struct sample {
+	struct position pos;
+	struct pstate pstate;
+	move_t pseudo[MOVES_MAX];
+	move_t moves[MOVES_MAX];
+	struct history *history;
+};
+
+static struct sample *samples;
+static size_t samples_num;
+
+static struct transpositiontable tt;
+static uint64_t *keys;
+static size_t keys_num;
+
+/* Results are summed here so that the compiler cannot remove the calls. */
+static volatile uint64_t sink;
+
+static uint64_t micro_movegen(void) {
+	uint64_t ops = 0, sum = 0;
+	move_t moves[MOVES_MAX];
+	for (size_t i = 0; i < samples_num; i++, ops++) {
+		struct sample *s  = &samples[i];
+		sum              += movegen(&s->pos, &s->pstate, moves, MOVETYPE_ALL) - moves;
+	}
+	sink += sum;
+	return ops;
+}
+
+static uint64_t micro_legal(void) {
+	uint64_t ops = 0, sum = 0;
+	for (size_t i = 0; i < samples_num; i++) {
+		struct sample *s = &samples[i];
+		for (move_t *move = s->pseudo; *move; move++, ops++)
+			sum += legal(&s->pos, &s->pstate, move);
+	}
+	sink += sum;
+	return ops;
+}
+
+static uint64_t micro_do_move(void) {
+	uint64_t ops = 0, sum = 0;
+	for (size_t i = 0; i < samples_num; i++) {
+		struct sample *s = &samples[i];
+		for (move_t *m = s->moves; *m; m++, ops++) {
+			move_t move = *m;
+			do_move(&s->pos, &move);
+			sum += s->pos.piece[WHITE][ALL];
+			undo_move(&s->pos, &move);
+		}
+	}
+	sink += sum;
+	return ops;
+}
+
+static uint64_t micro_see_geq(void) {
+	uint64_t ops = 0, sum = 0;
+	for (size_t i = 0; i < samples_num; i++) {
+		struct sample *s = &samples[i];
+		for (move_t *move = s->moves; *move; move++, ops++)
+			sum += see_geq(&s->pos, move, 0);
+	}
+	sink += sum;
+	return ops;
+}
+
+static uint64_t micro_refresh_accumulator(void) {
+	uint64_t ops = 0, sum = 0;
+	for (size_t i = 0; i < samples_num; i++, ops++) {
+		struct sample *s = &samples[i];
+		refresh_accumulator(&s->pos, i % 2);
+		sum += s->pos.accumulation[i % 2][0];
+	}
+	sink += sum;
+	return ops;
+}
+
+/* The accumulator can only be updated after the move has been made, so this
+ * includes the cost of do_move and undo_move.
+ */
+static uint64_t micro_do_accumulator(void) {
+	uint64_t ops = 0, sum = 0;
+	for (size_t i = 0; i < samples_num; i++) {
+		struct sample *s = &samples[i];
+		for (move_t *m = s->moves; *m; m++, ops++) {
+			move_t move = *m;
+			do_move(&s->pos, &move);
+			do_accumulator(&s->pos, &move);
+			sum += s->pos.accumulation[WHITE][0];
+			undo_move(&s->pos, &move);
+			undo_accumulator(&s->pos, &move);
+		}
+	}
+	sink += sum;
+	return ops;
+}
+
+static uint64_t micro_evaluate_accumulator(void) {
+	uint64_t ops = 0, sum = 0;
+	for (size_t i = 0; i < samples_num; i++, ops++)
+		sum += evaluate_accumulator(&samples[i].pos);
+	sink += sum;
+	return ops;
+}
+
+static uint64_t micro_transposition_probe(void) {
+	uint64_t ops = 0, sum = 0;
+	struct position pos;
+	for (size_t i = 0; i < keys_num; i++, ops++) {
+		pos.zobrist_key = keys[i];
+		sum            += transposition_probe(&tt, &pos) != NULL;
+	}
+	sink += sum;
+	return ops;
+}
+
+static uint64_t micro_upcoming_repetition(void) {
+	uint64_t ops = 0, sum = 0;
+	for (size_t i = 0; i < samples_num; i++) {
+		struct sample *s = &samples[i];
+		if (!s->history)
+			continue;
+		sum += upcoming_repetition(&s->pos, s->history, 0);
+		ops++;
+	}
+	sink += sum;
+	return ops;
+}
+
+struct micro {
+	const char *name;
+	uint64_t (*func)(void);
+};
+
+#define MICRO(name) { #name, micro_##name }
+
+static const struct micro micros[] = {
+	MICRO(movegen),
+	MICRO(legal),
+	MICRO(do_move),
+	MICRO(see_geq),
+	MICRO(refresh_accumulator),
+	MICRO(do_accumulator),
+	MICRO(evaluate_accumulator),
+	MICRO(transposition_probe),
+	MICRO(upcoming_repetition),
+};
+
+static void add_sample(const struct position *pos) {
+	struct sample *s = &samples[samples_num++];
+	s->pos           = *pos;
+	refresh_zobrist_key(&s->pos);
+	refresh_endgame_key(&s->pos);
+	refresh_accumulator(&s->pos, WHITE);
+	refresh_accumulator(&s->pos, BLACK);
+	pstate_init(&s->pos, &s->pstate);
+	movegen(&s->pos, &s->pstate, s->pseudo, MOVETYPE_ALL);
+	movegen_legal(&s->pos, s->moves, MOVETYPE_ALL);
+	s->history = NULL;
+}
+
+/* Plays a few reversible moves from a bench position so that
+ * upcoming_repetition has something to look through.
+ */
+static void make_history(struct sample *s, uint64_t *seed) {
+	struct position pos = s->pos;
+	s->history          = malloc(sizeof(*s->history));
+	if (!s->history) {
+		fprintf(stderr, "error: failed to allocate memory\n");
+		exit(1);
+	}
+	history_reset(&pos, s->history);
+
+	move_t moves[MOVES_MAX];
+	for (int i = 0; i < 8; i++) {
+		movegen_legal(&pos, moves, MOVETYPE_QUIET);
+		int count   = move_count(moves);
+		move_t move = 0;
+		for (int j = 0; j < 16 && !move; j++) {
+			move = count ? moves[xorshift64(seed) % count] : 0;
+			if (move && uncolored_piece(pos.mailbox[move_from(&move)]) == PAWN)
+				move = 0;
+		}
+		if (!move)
+			break;
+		history_next(&pos, s->history, move);
+	}
+
+	history_store(&pos, s->history, 0);
+	s->pos = pos;
+	refresh_accumulator(&s->pos, WHITE);
+	refresh_accumulator(&s->pos, BLACK);
+	pstate_init(&s->pos, &s->pstate);
+	movegen(&s->pos, &s->pstate, s->pseudo, MOVETYPE_ALL);
+	movegen_legal(&s->pos, s->moves, MOVETYPE_ALL);
+}
+
+static void samples_init(size_t hash) {
+	samples = malloc(bench_fens_num * MOVES_MAX * sizeof(*samples));
+	if (!samples) {
+		fprintf(stderr, "error: failed to allocate memory\n");
+		exit(1);
+	}
+
+	struct position pos;
+	move_t moves[MOVES_MAX];
+	uint64_t seed = 1;
+	for (size_t i = 0; i < bench_fens_num; i++) {
+		pos_from_fen2(&pos, bench_fens[i]);
+		movegen_legal(&pos, moves, MOVETYPE_ALL);
+		for (move_t *move = moves; *move; move++) {
+			do_move(&pos, move);
+			add_sample(&pos);
+			undo_move(&pos, move);
+		}
+		add_sample(&pos);
+		make_history(&samples[samples_num - 1], &seed);
+	}
+	struct sample *t = realloc(samples, samples_num * sizeof(*samples));
+	if (t)
+		samples = t;
+
+	if (transposition_alloc(&tt, hash)) {
+		fprintf(stderr, "error: failed to allocate transposition table\n");
+		exit(1);
+	}
+
+	/* Every other key is stored so that half of the probes hit. */
+	keys = malloc(samples_num * sizeof(*keys));
+	if (!keys) {
+		fprintf(stderr, "error: failed to allocate memory\n");
+		exit(1);
+	}
+	for (size_t i = 0; i < samples_num; i++) {
+		keys[keys_num++] = samples[i].pos.zobrist_key;
+		if (i % 2)
+			transposition_set(transposition_get(&tt, &samples[i].pos), &samples[i].pos, 0, 0, 1, BOUND_EXACT, 0);
+	}
+}
+
+static void samples_free(void) {
+	for (size_t i = 0; i < samples_num; i++)
+		free(samples[i].history);
+	free(samples);
+	free(keys);
+	transposition_free(&tt);
+}
+
+/* Each round repeats the primitive for at least round_time. The first round
+ * is a warm-up and is used to decide the number of repetitions.
+ */
+static void measure(const struct micro *micro, int rounds, timepoint_t round_time) {
+	timepoint_t start = time_now();
+	uint64_t ops      = micro->func();
+	timepoint_t t     = time_now() - start;
+
+	uint64_t reps = t < round_time ? round_time / (t > 0 ? t : 1) : 1;
+
+	double *ns    = malloc(rounds * sizeof(*ns));
+	double mean   = 0.0;
+	if (!ns) {
+		fprintf(stderr, "error: failed to allocate memory\n");
+		exit(1);
+	}
+	for (int r = 0; r < rounds; r++) {
+		start = time_now();
+		for (uint64_t i = 0; i < reps; i++)
+			micro->func();
+		t      = time_now() - start;
+		ns[r]  = (double)t / (reps * ops);
+		mean  += ns[r];
+	}
+	mean            /= rounds;
+
+	double variance  = 0.0, best = ns[0];
+	for (int r = 0; r < rounds; r++) {
+		variance += (ns[r] - mean) * (ns[r] - mean);
+		best      = fmin(best, ns[r]);
+	}
+	variance /= rounds;
+
+	printf("%-22s %10.2f ns/op %8.2f sd %10.2f min %12" PRIu64 " ops\n", micro->name, mean, sqrt(variance), best,
+	       reps * ops);
+	free(ns);
+}
+
+int main(int argc, char **argv) {
+	int rounds                  = 10;
+	long round_time             = 100;
+	long hash                   = 64;
+	static struct option opts[] = {
+		{     "rounds", required_argument, NULL, 'r' },
+		{ "round-time", required_argument, NULL, 't' },
+		{       "hash", required_argument, NULL, 'h' },
+		{         NULL,                 0, NULL,   0 },
+	};
+
+	char *endptr;
+	int c, option_index = 0;
+	int error = 0;
+	while ((c = getopt_long(argc, argv, "r:t:h:", opts, &option_index)) != -1) {
+		switch (c) {
+		case 'r':
+			rounds = strtol(optarg, &endptr, 10);
+			if (*endptr != '\0' || rounds <= 0)
+				return 2;
+			break;
+		case 't':
+			round_time = strtol(optarg, &endptr, 10);
+			if (*endptr != '\0' || round_time <= 0)
+				return 2;
+			break;
+		case 'h':
+			hash = strtol(optarg, &endptr, 10);
+			if (*endptr != '\0' || hash <= 0)
+				return 2;
+			break;
+		default:
+			error = 1;
+			break;
+		}
+	}
+	if (error)
+		return 1;
+
+	for (int i = optind; i < argc; i++) {
+		size_t k;
+		for (k = 0; k < SIZE(micros); k++)
+			if (!strcmp(argv[i], micros[k].name))
+				break;
+		if (k == SIZE(micros)) {
+			fprintf(stderr, "error: unknown primitive '%s'\n", argv[i]);
+			fprintf(stderr, "usage: %s [--rounds n] [--round-time ms] [--hash MiB] [primitive ...]\n", argv[0]);
+			return 3;
+		}
+	}
+
+	option_transposition = 1;
+	option_history       = 1;
+
+	magicbitboard_init();
+	attackgen_init();
+	bitboard_init();
+	search_init();
+	moveorder_init();
+	position_init();
+	transposition_init();
+	endgame_init();
+	history_init();
+	nnue_init();
+
+	samples_init(hash * 1024 * 1024);
+
+	printf("%zu positions, %d rounds of %ld ms\n", samples_num, rounds, round_time);
+	for (size_t k = 0; k < SIZE(micros); k++) {
+		int selected = optind == argc;
+		for (int i = optind; i < argc; i++)
+			selected |= !strcmp(argv[i], micros[k].name);
+		if (selected)
+			measure(&micros[k], rounds, round_time * TPPERMS);
+	}
+
+	samples_free();
+}
@@ -398,22 +398,23 @@ char *move_str_pgn(char *str, const struct position *pos, const move_t *move) {
 	}
 
 	move_t moves[MOVES_MAX];
-	uint64_t attackers = 0;
-	if (uncolored_piece(pos->mailbox[move_from(move)]) == PAWN) {
+	int piece          = uncolored_piece(pos->mailbox[move_from(move)]);
+	uint64_t attackers = bitboard(move_from(move));
+	if (piece == PAWN) {
 		if (is_capture(pos, move) || move_flag(move) == MOVE_EN_PASSANT)
 			attackers = rank(move_from(move));
-		else
-			attackers = bitboard(move_from(move));
 	}
 	else {
-		movegen_legal(pos, moves, MOVETYPE_ALL);
-		for (move_t *ptr = moves; *ptr; ptr++) {
-			if (move_to(ptr) == move_to(move)
-			    && pos->mailbox[move_from(ptr)] == pos->mailbox[move_from(move)])
-				attackers |= bitboard(move_from(ptr));
+		/* The other pieces of the same kind that can legally move to the
+		 * target square.
+		 */
+		uint64_t b = attacks(piece, move_to(move), 0, all_pieces(pos)) & pos->piece[pos->turn][piece];
+		for (; b; b = clear_ls1b(b)) {
+			move_t other = new_move(ctz(b), move_to(move), 0, 0);
+			if (pseudo_legal(pos, &pstate, &other) && legal(pos, &pstate, &other))
+				attackers |= bitboard(ctz(b));
 		}
 	}
-	assert(attackers);
 
 	if (popcount(attackers & file(move_from(move))) > 1) {
 		if (popcount(attackers & rank(move_from(move))) > 1)
@@ -451,20 +452,124 @@ char *move_str_pgn(char *str, const struct position *pos, const move_t *move) {
 	return str;
 }
 
-/* str can be illegal. */
+/* Parses str in standard algebraic notation, such as Nbd7, exd6, e8=Q or O-O.
+ * Suffixes for checks and annotations are ignored. Instead of generating all
+ * legal moves, the source square is found by the attacks to the target square
+ * of the pieces of the given kind. Returns 0 if the move is illegal or
+ * ambiguous.
+ */
+move_t san_to_move(const struct position *pos, const char *str) {
+	const int us  = pos->turn;
+	unsigned down = us ? S : N;
+
+	size_t len = strlen(str);
+	while (len && strchr("+#!?", str[len - 1]))
+		len--;
+	if (len < 2)
+		return 0;
+
+	struct pstate pstate;
+	pstate_init(pos, &pstate);
+	move_t move;
+
+	if ((len == 3 && !strncmp(str, "O-O", 3)) || (len == 5 && !strncmp(str, "O-O-O", 5))) {
+		int king_square = ctz(pos->piece[us][KING]);
+		if (file_of(king_square) != 4)
+			return 0;
+		move = new_move(king_square, king_square + (len == 3 ? 2 : -2), MOVE_CASTLE, 0);
+		return pseudo_legal(pos, &pstate, &move) && legal(pos, &pstate, &move) ? move : 0;
+	}
+
+	const char *c   = str;
+	const char *end = str + len;
+	const char *p;
+	int piece = PAWN;
+	if ((p = strchr("NBRQK", *c))) {
+		piece = KNIGHT + (p - "NBRQK");
+		c++;
+	}
+
+	int flag = 0, promotion = 0;
+	if (piece == PAWN && end - c > 2 && (p = strchr("NBRQ", end[-1]))) {
+		flag      = MOVE_PROMOTION;
+		promotion = p - "NBRQ";
+		end      -= end[-2] == '=' ? 2 : 1;
+	}
+
+	if (end - c < 2 || end[-2] < 'a' || end[-2] > 'h' || end[-1] < '1' || end[-1] > '8')
+		return 0;
+	int to_square = make_square(end[-2] - 'a', end[-1] - '1');
+	uint64_t to   = bitboard(to_square);
+
+	int from_file = -1, from_rank = -1, capture = 0;
+	for (; c < end - 2; c++) {
+		if ('a' <= *c && *c <= 'h' && from_file < 0 && from_rank < 0 && !capture)
+			from_file = *c - 'a';
+		else if ('1' <= *c && *c <= '8' && from_rank < 0 && !capture)
+			from_rank = *c - '1';
+		else if (*c == 'x' && !capture)
+			capture = 1;
+		else
+			return 0;
+	}
+
+	uint64_t from;
+	if (piece == PAWN) {
+		if (from_rank >= 0 || (from_file >= 0) != capture)
+			return 0;
+		if (capture && pos->en_passant && to_square == pos->en_passant && !pos->mailbox[to_square])
+			flag = MOVE_EN_PASSANT;
+		if ((flag == MOVE_PROMOTION) != !!(to & (us ? RANK_8 : RANK_1)))
+			return 0;
+		if (capture) {
+			from = shift(to, down | E) | shift(to, down | W);
+		}
+		else {
+			from = shift(to, down);
+			if (!(from & all_pieces(pos)))
+				from |= shift_twice(to, down) & (us ? RANK_2 : RANK_7);
+		}
+	}
+	else {
+		from = attacks(piece, to_square, 0, all_pieces(pos));
+	}
+	if (capture != (pos->mailbox[to_square] || flag == MOVE_EN_PASSANT))
+		return 0;
+
+	from &= pos->piece[us][piece];
+	if (from_file >= 0)
+		from &= file(from_file);
+	if (from_rank >= 0)
+		from &= rank(8 * from_rank);
+
+	move_t found = 0;
+	for (; from; from = clear_ls1b(from)) {
+		move = new_move(ctz(from), to_square, flag, promotion);
+		if (pseudo_legal(pos, &pstate, &move) && legal(pos, &pstate, &move)) {
+			if (found)
+				return 0;
+			found = move;
+		}
+	}
+	return found;
+}
+
+/* str can be illegal. Both standard algebraic notation and the notation of
+ * the uci protocol, such as e7e8q, are accepted.
+ */
 move_t string_to_move(const struct position *pos, const char *str) {
 	if (!str)
 		return 0;
+	move_t move = san_to_move(pos, str);
+	if (move)
+		return move;
 	move_t moves[MOVES_MAX];
 	movegen_legal(pos, moves, MOVETYPE_ALL);
 	char str_t[8];
-	for (move_t *move = moves; *move; move++) {
-		move_str_algebraic(str_t, move);
-		if (strcmp(str_t, str) == 0)
-			return *move;
-		move_str_pgn(str_t, pos, move);
+	for (move_t *ptr = moves; *ptr; ptr++) {
+		move_str_algebraic(str_t, ptr);
 		if (strcmp(str_t, str) == 0)
-			return *move;
+			return *ptr;
 	}
 	return 0;
 }
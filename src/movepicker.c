@@ -57,6 +57,27 @@ static int find_next(struct movepicker *mp, int (*filter)(struct position *, mov
 	return 0;
 }
 
+/* Moves the best remaining move to the front while keeping the relative
+ * order of the other moves. Repeated calls thus give the same order as
+ * sort_moves, but we only pay for the moves that are actually tried.
+ * Most cut nodes only need the first one or two moves.
+ */
+static inline void pick_next(struct movepicker *mp) {
+	int best = 0, i;
+	for (i = 1; mp->move[i]; i++)
+		if (mp->eval[i] > mp->eval[best])
+			best = i;
+	STAT(mp->stats ? mp->stats->pick_comparisons += i - 1 : 0);
+	move_t move  = mp->move[best];
+	int64_t eval = mp->eval[best];
+	for (int j = best; j > 0; j--) {
+		mp->move[j] = mp->move[j - 1];
+		mp->eval[j] = mp->eval[j - 1];
+	}
+	mp->move[0] = move;
+	mp->eval[0] = eval;
+}
+
 void sort_moves(struct movepicker *mp) {
 	if (!mp->move[0])
 		return;
@@ -68,11 +89,32 @@ void sort_moves(struct movepicker *mp) {
 			mp->move[j + 1] = mp->move[j];
 			mp->eval[j + 1] = mp->eval[j];
 		}
+		STAT(mp->stats ? mp->stats->sort_comparisons += i - max(j, 0) : 0);
 		mp->move[j + 1] = move;
 		mp->eval[j + 1] = eval;
 	}
 }
 
+#ifdef STATS
+/* Returns the comparisons sort_moves needs for the remaining moves, without
+ * sorting them, to compare with those of pick_next.
+ */
+static uint64_t sort_comparisons(const struct movepicker *mp) {
+	struct searchstats stats = { 0 };
+	struct movepicker t      = { .stats = &stats };
+	int i;
+	for (i = 0; mp->move[i]; i++) {
+		t.moves[i] = mp->move[i];
+		t.evals[i] = mp->eval[i];
+	}
+	t.moves[i] = 0;
+	t.move     = t.moves;
+	t.eval     = t.evals;
+	sort_moves(&t);
+	return stats.sort_comparisons;
+}
+#endif
+
 static void evaluate_nonquiet(struct movepicker *mp) {
 	for (int i = 0; mp->move[i]; i++) {
 		move_t *move    = &mp->move[i];
@@ -199,12 +241,15 @@ move_t next_move(struct movepicker *mp) {
 		/* fallthrough */
 	case STAGE_SORTQUIET:
 		evaluate_quiet(mp);
-		sort_moves(mp);
+		STAT(mp->stats ? mp->stats->quiet_sort_comparisons += sort_comparisons(mp) : 0);
 		mp->stage++;
 		/* fallthrough */
 	case STAGE_GOODQUIET:
-		if (*mp->move && !mp->prune && *mp->eval > goodquiet_threshold)
-			return mp->eval++, *mp->move++;
+		if (*mp->move && !mp->prune) {
+			pick_next(mp);
+			if (*mp->eval > goodquiet_threshold)
+				return mp->eval++, *mp->move++;
+		}
 		mp->stage++;
 		/* fallthrough */
 	case STAGE_BADNONQUIET:
@@ -213,8 +258,10 @@ move_t next_move(struct movepicker *mp) {
 		mp->stage++;
 		/* fallthrough */
 	case STAGE_BADQUIET:
-		if (*mp->move && !mp->prune)
-			return *mp->move++;
+		if (*mp->move && !mp->prune) {
+			pick_next(mp);
+			return mp->eval++, *mp->move++;
+		}
 		mp->stage++;
 		/* fallthrough */
 	case STAGE_DONE:
@@ -247,4 +294,7 @@ void movepicker_init(struct movepicker *mp, int quiescence, struct position *pos
 	mp->counter_move = counter_move;
 
 	mp->stage        = STAGE_TT;
+#ifdef STATS
+	mp->stats = NULL;
+#endif
 }
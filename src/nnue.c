@@ -52,7 +52,8 @@ struct ftcache {
 	int set;
 };
 
-struct ftcache ftcache[2][64];
+/* Every search thread refreshes its accumulators from its own cache. */
+_Thread_local struct ftcache ftcache[2][64];
 
 static void reset_ftcache(void) {
 	for (int color = 0; color < 2; color++)
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <strings.h>
 
+#include "endgame.h"
 #include "interface.h"
 #include "nnue.h"
 #include "transposition.h"
@@ -51,6 +52,7 @@ void print_options(void) {
 	printf("option name Ponder type check default %s\n", OPTION_PONDER ? "true" : "false");
 	printf("option name FileNNUE type string\n");
 	printf("option name BuiltinNNUE type button\n");
+	printf("option name BitbasePath type string\n");
 	printf("option name Deterministic type check default %s\n", OPTION_DETERMINISTIC ? "true" : "false");
 	printf("option name Debug type check default %s\n", OPTION_DEBUG ? "true" : "false");
 	print_tune();
@@ -99,6 +101,8 @@ void setoption(int argc, char **argv, struct transpositiontable *tt) {
 		option_ponder = set;
 	else if (!strcasecmp(argv[2], "filennue"))
 		file_nnue(argv[4]);
+	else if (!strcasecmp(argv[2], "bitbasepath"))
+		endgame_bitbases(argv[4]);
 	else if (!strcasecmp(argv[2], "deterministic"))
 		option_deterministic = set;
 	else if (!strcasecmp(argv[2], "debug"))
@@ -16,14 +16,19 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "attackgen.h"
 #include "bitboard.h"
@@ -48,6 +53,42 @@ int verbose                        = 0;
 
 static const struct searchinfo gsi = { 0 };
 
+/* The games are parsed GAMES_BATCH at a time by the threads and then written
+ * in order.
+ */
+#define GAMES_BATCH 4096
+
+/* A game of the pgn file, parsed by one of the threads. The game has ply + 1
+ * positions and ply moves. A game with skip set is not written and a game
+ * with error set ends the program.
+ */
+struct game {
+	size_t offset;
+	uint64_t seed;
+
+	struct position start;
+	signed char result;
+	int ply;
+	int capacity;
+	move_t *moves;
+	int32_t *evals;
+	unsigned char *flags;
+
+	int skip;
+	size_t error_offset;
+	char error[512];
+};
+
+struct worker {
+	pthread_t thread;
+	const char *data;
+	size_t size;
+	struct game *games;
+	size_t first;
+	size_t games_num;
+	size_t step;
+};
+
 static int32_t evaluate_material(const struct position *pos) {
 	int32_t eval = 0;
 	for (int piece = PAWN; piece < KING; piece++)
@@ -148,14 +189,12 @@ static void start_fen(struct position *pos, FILE *f) {
 }
 #endif
 
-static void line_error(FILE *f, const char *error) {
+static void line_error(const char *data, size_t p, const char *error) {
 	long newlines = 0;
 	long chars    = 0;
-	long p        = ftell(f);
-	fseek(f, 0, SEEK_SET);
-	for (long q = 1; q <= p; q++) {
+	for (size_t q = 1; q <= p; q++) {
 		chars++;
-		if (fgetc(f) == '\n') {
+		if (data[q - 1] == '\n') {
 			newlines++;
 			chars = 0;
 		}
@@ -166,10 +205,16 @@ static void line_error(FILE *f, const char *error) {
 	exit(1);
 }
 
-static void line_expect(FILE *f, const char *expect, const char *got) {
-	char error[3 * BUFSIZ];
-	sprintf(error, "expected '%s' but got '%s'", expect, got);
-	line_error(f, error);
+static int game_error(struct game *game, size_t offset, const char *error) {
+	game->error_offset = offset;
+	snprintf(game->error, sizeof(game->error), "%s", error);
+	return 1;
+}
+
+static int game_expect(struct game *game, size_t offset, const char *expect, const char *got) {
+	game->error_offset = offset;
+	snprintf(game->error, sizeof(game->error), "expected '%s' but got '%s'", expect, got);
+	return 1;
 }
 
 static char *parse_quote(char *line, char *quotes) {
@@ -191,16 +236,31 @@ static char *parse_quote(char *line, char *quotes) {
 	return index && in_quote == 0 ? quotes : NULL;
 }
 
-static char *next_token(char *token, int n, FILE *f) {
-	int c, index = 0, in_braces = 0;
+/* Reads a line like fgets, but from the mapped file. */
+static char *next_line(char *line, size_t n, const char *data, size_t *offset, size_t size) {
+	if (*offset >= size)
+		return NULL;
+	size_t index = 0;
+	while (index < n - 1 && *offset < size) {
+		char c        = data[(*offset)++];
+		line[index++] = c;
+		if (c == '\n')
+			break;
+	}
+	line[index] = '\0';
+	return line;
+}
+
+/* Returns NULL at the end of the file. */
+static char *next_token(char *token, int n, const char *data, size_t *offset, size_t size) {
+	int index = 0, in_braces = 0;
 	token[0] = '\0';
 
 	while (index < n - 1) {
-		c = fgetc(f);
+		if (*offset >= size)
+			return NULL;
+		char c = data[(*offset)++];
 		switch (c) {
-		case EOF:
-			line_error(f, "unexpected EOF");
-			break;
 		case '{':
 			in_braces = 1;
 			break;
@@ -220,7 +280,26 @@ static char *next_token(char *token, int n, FILE *f) {
 	return token;
 }
 
-static void parse_pgn(FILE *infile, FILE *outfile) {
+static int game_reserve(struct game *game, int n) {
+	if (n <= game->capacity)
+		return 0;
+	move_t *moves        = realloc(game->moves, n * sizeof(*moves));
+	int32_t *evals       = realloc(game->evals, n * sizeof(*evals));
+	unsigned char *flags = realloc(game->flags, n * sizeof(*flags));
+	if (moves)
+		game->moves = moves;
+	if (evals)
+		game->evals = evals;
+	if (flags)
+		game->flags = flags;
+	if (!moves || !evals || !flags)
+		return 1;
+	game->capacity = n;
+	return 0;
+}
+
+static int parse_pgn(struct game *game, const char *data, size_t size) {
+	size_t offset = game->offset;
 	struct position pos;
 	move_t move;
 	int32_t eval;
@@ -234,23 +313,26 @@ static void parse_pgn(FILE *infile, FILE *outfile) {
 	char line[BUFSIZ], quotes[BUFSIZ], *endptr;
 	char token[BUFSIZ] = { 0 }, expect[BUFSIZ] = { 0 };
 
-	while (fgets(line, sizeof(line), infile)) {
+	game->skip     = 0;
+	game->error[0] = '\0';
+
+	while (next_line(line, sizeof(line), data, &offset, size)) {
 		if (!strncmp(line, "[White ", 7)) {
 			if (!parse_quote(line, white))
-				line_error(infile, "bad player");
+				return game_error(game, offset, "bad player");
 		}
 		else if (!strncmp(line, "[Black ", 7)) {
 			if (!parse_quote(line, black))
-				line_error(infile, "bad player");
+				return game_error(game, offset, "bad player");
 		}
 		else if (!strncmp(line, "[FEN ", 5)) {
 			if (!parse_quote(line, quotes) || !fen_is_ok2(quotes))
-				line_error(infile, "bad fen");
+				return game_error(game, offset, "bad fen");
 			pos_from_fen2(&pos, quotes);
 		}
 		else if (!strncmp(line, "[Result ", 8)) {
 			if (!parse_quote(line, quotes))
-				line_error(infile, "bad result");
+				return game_error(game, offset, "bad result");
 
 			if (!strcmp(quotes, "1-0"))
 				result = RESULT_WIN;
@@ -259,18 +341,18 @@ static void parse_pgn(FILE *infile, FILE *outfile) {
 			else if (!strcmp(quotes, "1/2-1/2"))
 				result = RESULT_DRAW;
 			else
-				line_error(infile, "bad result");
+				return game_error(game, offset, "bad result");
 		}
 		else if (!strncmp(line, "[PlyCount ", 10)) {
 			errno = 0;
 			if (!parse_quote(line, quotes) || (plycount = strtol(quotes, &endptr, 10)) <= 0 || errno
 			    || *endptr != '\0')
-				line_error(infile, "bad plycount");
+				return game_error(game, offset, "bad plycount");
 		}
 		else if (!strncmp(line, "[Termination ", 13)) {
 			if (!strstr(line, "adjudication")) {
-				fprintf(stderr, "warning: skipping bad game\n");
-				return;
+				game->skip = 1;
+				return 0;
 			}
 		}
 
@@ -279,39 +361,48 @@ static void parse_pgn(FILE *infile, FILE *outfile) {
 	}
 
 	if (result == RESULT_UNKNOWN)
-		line_error(infile, "no result");
+		return game_error(game, offset, "no result");
 
 	if (plycount == -1)
-		line_error(infile, "no plycount");
+		return game_error(game, offset, "no plycount");
+
+	if (game_reserve(game, plycount))
+		return game_error(game, offset, "malloc");
 
-	write_move(outfile, 0);
-	write_position(outfile, &pos);
-	write_result(outfile, result);
+	game->start  = pos;
+	game->result = result;
+	game->ply    = -1;
 
 	/* Special case when black is the first to move. */
 	if (!pos.turn) {
 		sprintf(expect, "%d...", pos.fullmove);
-		if (strcmp(expect, next_token(token, sizeof(token), infile)))
-			line_expect(infile, expect, token);
+		if (!next_token(token, sizeof(token), data, &offset, size))
+			return game_error(game, offset, "unexpected EOF");
+		if (strcmp(expect, token))
+			return game_expect(game, offset, expect, token);
 	}
 
 	for (int i = 1; i <= plycount; i++) {
 		if (pos.turn) {
 			sprintf(expect, "%d.", pos.fullmove);
-			if (strcmp(expect, next_token(token, sizeof(token), infile)))
-				line_expect(infile, expect, token);
+			if (!next_token(token, sizeof(token), data, &offset, size))
+				return game_error(game, offset, "unexpected EOF");
+			if (strcmp(expect, token))
+				return game_expect(game, offset, expect, token);
 		}
 
 		/* move */
-		next_token(token, sizeof(token), infile);
+		if (!next_token(token, sizeof(token), data, &offset, size))
+			return game_error(game, offset, "unexpected EOF");
 		move = string_to_move(&pos, token);
 		if (!move)
-			line_error(infile, "bad move");
+			return game_error(game, offset, "bad move");
 
 		/* comment */
 		eval = VALUE_NONE;
 		flag = 0;
-		next_token(token, sizeof(token), infile);
+		if (!next_token(token, sizeof(token), data, &offset, size))
+			return game_error(game, offset, "unexpected EOF");
 
 		endptr = strchr(token, '/');
 		if (endptr) {
@@ -327,7 +418,7 @@ static void parse_pgn(FILE *infile, FILE *outfile) {
 					int ply = strtol(&token[2], &endptr, 10);
 					if ((token[0] != '+' && token[0] != '-') || errno || *endptr != '\0'
 					    || ply <= 0)
-						line_error(infile, "bad mate score");
+						return game_error(game, offset, "bad mate score");
 					eval = (2 * (token[0] == '+') - 1) * (VALUE_MATE - ply);
 				}
 			}
@@ -335,7 +426,7 @@ static void parse_pgn(FILE *infile, FILE *outfile) {
 				errno        = 0;
 				double score = strtod(token, &endptr);
 				if (errno || *endptr != '\0')
-					line_error(infile, "bad score");
+					return game_error(game, offset, "bad score");
 				eval = 100 * score;
 			}
 		}
@@ -349,7 +440,7 @@ static void parse_pgn(FILE *infile, FILE *outfile) {
 			}
 		}
 
-		if (!(flag & FLAG_SKIP) && skip_halfmove && !gbernoulli(exp(-pos.halfmove)))
+		if (!(flag & FLAG_SKIP) && skip_halfmove && !bernoulli(exp(-pos.halfmove), &game->seed))
 			flag |= FLAG_SKIP;
 
 		if (!(flag & FLAG_SKIP) && quiet
@@ -362,39 +453,51 @@ static void parse_pgn(FILE *infile, FILE *outfile) {
 		if (!(flag & FLAG_SKIP) && skip_checks && generate_checkers(&pos, pos.turn))
 			flag |= FLAG_SKIP;
 
+		/* The move after the last position of the game is not written. */
 		if (done_early <= 1) {
-			write_eval(outfile, eval);
-			write_flag(outfile, flag);
-		}
-		if (done_early == 0) {
-			if (i < plycount)
-				write_move(outfile, move);
+			game->ply++;
+			game->evals[game->ply] = eval;
+			game->flags[game->ply] = flag;
+			game->moves[game->ply] = move;
 		}
 		if (done_early == 1)
 			done_early = 2;
 	}
 
 	sprintf(expect, "%s", result == RESULT_WIN ? "1-0" : result == RESULT_LOSS ? "0-1" : "1/2-1/2");
-	if (strcmp(expect, next_token(token, sizeof(token), infile)))
-		line_expect(infile, expect, token);
+	if (!next_token(token, sizeof(token), data, &offset, size))
+		return game_error(game, offset, "unexpected EOF");
+	if (strcmp(expect, token))
+		return game_expect(game, offset, expect, token);
+	return 0;
+}
+
+static void *parse_games(void *arg) {
+	struct worker *worker = arg;
+	for (size_t i = worker->first; i < worker->games_num; i += worker->step)
+		parse_pgn(&worker->games[i], worker->data, worker->size);
+	return NULL;
 }
 
 int main(int argc, char **argv) {
 	char *inpath;
 	char *outpath;
+	int jobs                    = 1;
 	static struct option opts[] = {
-		{       "verbose", no_argument, NULL, 'v' },
-                {    "skip-mates", no_argument, NULL, 'm' },
-		{       "shuffle", no_argument, NULL, 's' },
-                {         "quiet", no_argument, NULL, 'q' },
-		{   "skip-checks", no_argument, NULL, 'c' },
-                { "skip-endgames", no_argument, NULL, 'e' },
-		{ "skip-halfmove", no_argument, NULL, 'h' },
-                {            NULL,           0, NULL,   0 },
+		{       "verbose",       no_argument, NULL, 'v' },
+                {    "skip-mates",       no_argument, NULL, 'm' },
+		{       "shuffle",       no_argument, NULL, 's' },
+                {         "quiet",       no_argument, NULL, 'q' },
+		{   "skip-checks",       no_argument, NULL, 'c' },
+                { "skip-endgames",       no_argument, NULL, 'e' },
+		{ "skip-halfmove",       no_argument, NULL, 'h' },
+                {          "jobs", required_argument, NULL, 'j' },
+		{            NULL,                 0, NULL,   0 },
 	};
+	char *endptr;
 	int c, option_index = 0;
 	int error = 0;
-	while ((c = getopt_long(argc, argv, "vmsqcehu", opts, &option_index)) != -1) {
+	while ((c = getopt_long(argc, argv, "vmsqcehuj:", opts, &option_index)) != -1) {
 		switch (c) {
 		case 'v':
 			verbose = 1;
@@ -417,25 +520,39 @@ int main(int argc, char **argv) {
 		case 'h':
 			skip_halfmove = 1;
 			break;
+		case 'j':
+			errno = 0;
+			jobs  = strtol(optarg, &endptr, 10);
+			if (errno || *endptr != '\0' || jobs < 1 || jobs > 1024)
+				error = 1;
+			break;
 		default:
 			error = 1;
 			break;
 		}
 	}
 	if (error || optind + 1 >= argc) {
-		fprintf(stderr, "usage: %s infile outfile\n", argv[0]);
+		fprintf(stderr, "usage: %s [--jobs n] infile outfile\n", argv[0]);
 		return 3;
 	}
-	inpath       = argv[optind];
-	outpath      = argv[optind + 1];
+	inpath  = argv[optind];
+	outpath = argv[optind + 1];
 
-	FILE *infile = fopen(inpath, "r");
-	if (!infile) {
+	int fd = open(inpath, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st)) {
 		fprintf(stderr, "failed to open file \"%s\"\n", inpath);
 		return 2;
 	}
-	FILE *outfile = fopen(outpath, "w");
-	if (!outfile) {
+	size_t size      = st.st_size;
+	const char *data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "failed to map file \"%s\"\n", inpath);
+		return 2;
+	}
+	struct bitwriter w;
+	if (bitwriter_open(&w, outpath, 1)) {
 		fprintf(stderr, "failed to open file \"%s\"\n", outpath);
 		return 2;
 	}
@@ -453,37 +570,80 @@ int main(int argc, char **argv) {
 	endgame_init();
 	uint64_t seed = time(NULL);
 
-	size_t total  = 0, count;
-	char line[BUFSIZ];
-	while (fgets(line, sizeof(line), infile))
-		if (!strncmp(line, "[Event ", 7))
-			total++;
-
-	long *offset = malloc(total * sizeof(*offset));
-	fseek(infile, 0, SEEK_SET);
-	count = 0;
-	while (fgets(line, sizeof(line), infile))
-		if (!strncmp(line, "[Event ", 7))
-			offset[count++] = ftell(infile) - strlen(line);
+	/* Every game starts with an Event tag at the start of a line. */
+	size_t total   = 0, count, capacity = 1024;
+	size_t *offset = malloc(capacity * sizeof(*offset));
+	for (const char *line = data; line;) {
+		if ((size_t)(data + size - line) >= 7 && !strncmp(line, "[Event ", 7)) {
+			if (total == capacity) {
+				capacity *= 2;
+				offset    = realloc(offset, capacity * sizeof(*offset));
+			}
+			offset[total++] = line - data;
+		}
+		const char *newline = memchr(line, '\n', data + size - line);
+		line                = newline ? newline + 1 : NULL;
+	}
 
 	/* Fisher-Yates shuffle. */
-	if (shuffle) {
+	if (shuffle && total) {
 		for (size_t i = total - 1; i > 0; i--) {
 			size_t j  = xorshift64(&seed) % (i + 1);
-			long t    = offset[i];
+			size_t t  = offset[i];
 			offset[i] = offset[j];
 			offset[j] = t;
 		}
 	}
 
-	for (count = 0; count < total; count++) {
-		fseek(infile, offset[count], SEEK_SET);
-		if (verbose)
-			printf("%ld / %ld\n", count + 1, total);
-		parse_pgn(infile, outfile);
+	/* The seed of a game only depends on its place in the output, so the
+	 * result does not depend on the number of threads.
+	 */
+	struct game *games     = calloc(GAMES_BATCH, sizeof(*games));
+	struct worker *workers = calloc(jobs, sizeof(*workers));
+	for (size_t batch = 0; batch < total; batch += GAMES_BATCH) {
+		size_t games_num = min(GAMES_BATCH, total - batch);
+		for (size_t i = 0; i < games_num; i++) {
+			games[i].offset = offset[batch + i];
+			games[i].seed   = (batch + i + 1) * 0x9E3779B97F4A7C15ull;
+		}
+		for (int i = 0; i < jobs; i++) {
+			workers[i].data      = data;
+			workers[i].size      = size;
+			workers[i].games     = games;
+			workers[i].first     = i;
+			workers[i].games_num = games_num;
+			workers[i].step      = jobs;
+			pthread_create(&workers[i].thread, NULL, parse_games, &workers[i]);
+		}
+		for (int i = 0; i < jobs; i++)
+			pthread_join(workers[i].thread, NULL);
+
+		for (count = batch; count < batch + games_num; count++) {
+			struct game *game = &games[count - batch];
+			if (verbose)
+				printf("%zu / %zu\n", count + 1, total);
+			if (game->error[0])
+				line_error(data, game->error_offset, game->error);
+			if (game->skip) {
+				fprintf(stderr, "warning: skipping bad game\n");
+				continue;
+			}
+			bitwriter_game(&w, &game->start, game->result, game->ply, game->moves, game->evals, game->flags);
+		}
 	}
 
+	for (size_t i = 0; i < GAMES_BATCH; i++) {
+		free(games[i].moves);
+		free(games[i].evals);
+		free(games[i].flags);
+	}
+	free(games);
+	free(workers);
 	free(offset);
-	fclose(infile);
-	fclose(outfile);
+	if (data)
+		munmap((void *)data, size);
+	if (bitwriter_close(&w)) {
+		fprintf(stderr, "failed to write file \"%s\"\n", outpath);
+		return 2;
+	}
 }
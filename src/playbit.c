@@ -28,6 +28,7 @@
 #include <sys/param.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #ifdef SYZYGY
 #include <tbprobe.h>
@@ -95,51 +96,77 @@ static void do_full_stop(void) {
 
 static inline int is_stopped(void) { return atomic_load_explicit(&stopvar, memory_order_relaxed); }
 
-static FILE *newfile(void) {
+/* Games are written to a hidden temporary file in the directory of the day,
+ * which is linked to the first free name n.bit when it is full. Readers never
+ * see a partially written file.
+ */
+static int newfile(struct bitwriter *w, char *dir, char *tmppath, int jobn) {
 	if (is_stopped())
-		return NULL;
+		return 1;
 
-	static long n        = 1;
 	static char date[64] = { 0 };
 
 	pthread_mutex_lock(&filemutex);
 
-	char name[BUFSIZ];
 	char tmp[64];
 	time_t t = time(NULL);
 	struct tm tm;
 	strftime(tmp, 64, "%Y%m%d", localtime_r(&t, &tm));
+	sprintf(dir, "%s/selfplay-%s", prefix, tmp);
 	if (strcmp(tmp, date)) {
 		memcpy(date, tmp, 64);
-		sprintf(name, "%s/selfplay-%s", prefix, date);
 
 		errno = 0;
-		if (mkdir(name, 0777) && errno != EEXIST) {
-			fprintf(stderr, "error: failed to create directory %s\n", name);
+		if (mkdir(dir, 0777) && errno != EEXIST) {
+			fprintf(stderr, "error: failed to create directory %s\n", dir);
 			do_stop();
 			pthread_mutex_unlock(&filemutex);
-			return NULL;
+			return 1;
 		}
-
-		n = 1;
 	}
 
-	int fd;
-	for (fd = -1; n < LONG_MAX && fd == -1; n++) {
-		sprintf(name, "%s/selfplay-%s/%ld.bit", prefix, date, n);
-		errno = 0;
-		fd    = open(name, O_WRONLY | O_CREAT | O_EXCL, 0644);
-		if (fd == -1 && errno != EEXIST) {
-			fprintf(stderr, "error: failed to create file %s\n", name);
-			do_stop();
-			pthread_mutex_unlock(&filemutex);
-			return NULL;
-		}
+	pthread_mutex_unlock(&filemutex);
+
+	sprintf(tmppath, "%s/.playbit-%d-%d.tmp", dir, (int)getpid(), jobn);
+	if (bitwriter_open(w, tmppath, 1)) {
+		fprintf(stderr, "error: failed to create file %s\n", tmppath);
+		do_stop();
+		return 1;
 	}
+	return 0;
+}
 
-	pthread_mutex_unlock(&filemutex);
+static void savefile(struct bitwriter *w, const char *dir, const char *tmppath) {
+	static long n            = 1;
+	static char last[BUFSIZ] = { 0 };
 
-	return fd != -1 ? fdopen(fd, "wb") : NULL;
+	size_t games = w->games;
+	if (bitwriter_close(w)) {
+		fprintf(stderr, "error: failed to write file %s\n", tmppath);
+		do_stop();
+	}
+	else if (games) {
+		pthread_mutex_lock(&filemutex);
+		if (strcmp(dir, last)) {
+			strcpy(last, dir);
+			n = 1;
+		}
+		char name[BUFSIZ + 32];
+		for (;; n++) {
+			sprintf(name, "%s/%ld.bit", dir, n);
+			if (!link(tmppath, name)) {
+				n++;
+				break;
+			}
+			if (errno != EEXIST || n == LONG_MAX) {
+				fprintf(stderr, "error: failed to create file %s\n", name);
+				do_stop();
+				break;
+			}
+		}
+		pthread_mutex_unlock(&filemutex);
+	}
+	unlink(tmppath);
 }
 
 static void custom_search(struct position *pos, uint64_t nodes, move_t moves[MOVES_MAX], int64_t evals[MOVES_MAX],
@@ -297,7 +324,8 @@ static move_t random_move(struct position *pos, uint64_t *seed) {
 	return filtered[uniformint(seed, 0, nmoves)];
 }
 
-static void play_game(FILE *openingsfile, struct transpositiontable *tt, uint64_t nodes, uint64_t *seed, FILE *out) {
+static void play_game(FILE *openingsfile, struct transpositiontable *tt, uint64_t nodes, uint64_t *seed,
+                      struct bitwriter *out) {
 	move_t moves[MOVES_MAX];
 	int64_t evals[MOVES_MAX];
 
@@ -515,38 +543,16 @@ static void play_game(FILE *openingsfile, struct transpositiontable *tt, uint64_
 	flag[h.ply] |= FLAG_SKIP;
 
 	if (h.ply) {
-		if (write_move(out, 0)) {
-			fprintf(stderr, "error: failed to write move\n");
-			do_stop();
-		}
-		if (write_position(out, &h.start)) {
-			fprintf(stderr, "error: failed to write position\n");
-			do_stop();
-		}
-		if (write_result(out, result)) {
-			fprintf(stderr, "error: failed to write result\n");
+		uint64_t size = out->size;
+		if (bitwriter_game(out, &h.start, result, h.ply, h.move, eval, flag)) {
+			fprintf(stderr, "error: failed to write game\n");
 			do_stop();
 		}
 		int count = 0;
-		for (int i = 0; i <= h.ply; i++) {
-			if (write_eval(out, eval[i])) {
-				fprintf(stderr, "error: failed to write eval\n");
-				do_stop();
-			}
-			if (write_flag(out, flag[i])) {
-				fprintf(stderr, "error: failed to write flag\n");
-				do_stop();
-			}
+		for (int i = 0; i <= h.ply; i++)
 			if (!(flag[i] & FLAG_SKIP) && eval[i] != VALUE_NONE)
 				count++;
-			if (i < h.ply) {
-				if (write_move(out, h.move[i])) {
-					fprintf(stderr, "error: failed to write move\n");
-					do_stop();
-				}
-			}
-		}
-		atomic_fetch_add_explicit(&bytes, 69 + 5 * h.ply, memory_order_relaxed);
+		atomic_fetch_add_explicit(&bytes, out->size - size, memory_order_relaxed);
 		atomic_fetch_add_explicit(&positions, count, memory_order_relaxed);
 	}
 }
@@ -585,15 +591,16 @@ static void *playthread(void *arg) {
 		if (is_stopped())
 			break;
 
-		FILE *f = newfile();
-		if (!f) {
+		struct bitwriter w;
+		char dir[BUFSIZ], tmppath[BUFSIZ + 64];
+		if (newfile(&w, dir, tmppath, ti->jobn)) {
 			fprintf(stderr, "error: failed to create new file\n");
 			do_stop();
 			break;
 		}
 
-		while (ftell(f) < max_file_size && !is_stopped()) {
-			play_game(openingsfile, &tt, nodes, &seed, f);
+		while (w.size < (uint64_t)max_file_size && !is_stopped()) {
+			play_game(openingsfile, &tt, nodes, &seed, &w);
 
 			pthread_mutex_lock(&pausemutex);
 			if (pausevar) {
@@ -603,7 +610,7 @@ static void *playthread(void *arg) {
 			pthread_mutex_unlock(&pausemutex);
 		}
 
-		fclose(f);
+		savefile(&w, dir, tmppath);
 	}
 
 	transposition_free(&tt);
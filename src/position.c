@@ -65,14 +65,23 @@ void print_fen(const struct position *pos) {
 }
 
 void pstate_init(const struct position *pos, struct pstate *pstate) {
+	pstate_init_core(pos, pstate);
+	pstate_init_extras(pos, pstate);
+}
+
+void pstate_init_core(const struct position *pos, struct pstate *pstate) {
 	const int us     = pos->turn;
-	const int them   = other_color(us);
 	pstate->checkers = generate_checkers(pos, us);
-	generate_attacked(pos, them, pstate->attacked);
 	pstate->checkray = single(pstate->checkers)
 	                     ? between(ctz(pos->piece[us][KING]), ctz(pstate->checkers)) | pstate->checkers
 	                     : 0;
 	pstate->pinned   = generate_pinned(pos, us);
+}
+
+void pstate_init_extras(const struct position *pos, struct pstate *pstate) {
+	const int us   = pos->turn;
+	const int them = other_color(us);
+	generate_attacked(pos, them, pstate->attacked);
 	generate_check_threats(pos, us, pstate->check_threats);
 }
 
@@ -34,6 +34,7 @@
 #include "nnue.h"
 #include "option.h"
 #include "position.h"
+#include "stats.h"
 #include "timeman.h"
 #include "transposition.h"
 #include "tune.h"
@@ -295,9 +296,9 @@ static inline void store_pv_move(const move_t *move, int ply, move_t pv[PLY_MAX]
 /* Random drawn score to avoid threefold blindness. */
 static inline int32_t draw(const struct searchinfo *si) { return 2 * (si->nodes & 0x3) - 3; }
 
-static inline int32_t evaluate(const struct position *pos, const struct searchinfo *si) {
+static inline int32_t evaluate(const struct position *pos, struct searchinfo *si) {
 	int32_t evaluation;
-	struct endgame *e = endgame_probe(pos);
+	struct endgame *e = material_probe(si->material_table, pos);
 	if (e && (evaluation = endgame_evaluate(e, pos)) != VALUE_NONE)
 		return evaluation;
 
@@ -327,6 +328,8 @@ static int32_t quiescence(struct position *pos, int ply, int32_t alpha, int32_t
 	if (si->sel_depth < ply)
 		si->sel_depth = ply;
 
+	STAT(si->stats.nodes[STATS_QUIESCENCE]++);
+
 	history_store(pos, si->history, ply);
 
 	const int pv_node = (beta != alpha + 1);
@@ -349,19 +352,26 @@ static int32_t quiescence(struct position *pos, int ply, int32_t alpha, int32_t
 	int ttbound             = tthit ? (e->boundflags & BOUND_EXACT) : 0;
 	int32_t ttstatic_eval   = tthit ? e->static_eval : VALUE_NONE;
 	move_t ttmove_unsafe    = tthit ? e->move : 0;
-	if (!pv_node && tthit && normal_eval(tteval) && ttbound & (tteval >= beta ? BOUND_LOWER : BOUND_UPPER))
+	STAT(si->stats.tt_probes[STATS_QUIESCENCE][ttbound]++);
+	if (!pv_node && tthit && normal_eval(tteval) && ttbound & (tteval >= beta ? BOUND_LOWER : BOUND_UPPER)) {
+		STAT(si->stats.tt_cutoffs[STATS_QUIESCENCE]++);
 		return tteval;
+	}
 
 	int32_t static_eval = tthit ? ttstatic_eval : evaluate(pos, si), best_eval = -VALUE_INFINITE, eval;
 
 	struct pstate pstate;
-	/* Skip generation of pstate if it was already generated during
-	 * the previous negamax.
+	/* Skip generation of the pstate core if it was already generated
+	 * during the previous negamax.
 	 */
-	if (pstateptr)
-		pstate = *pstateptr;
-	else
-		pstate_init(pos, &pstate);
+	if (pstateptr) {
+		pstate.checkers = pstateptr->checkers;
+		pstate.checkray = pstateptr->checkray;
+		pstate.pinned   = pstateptr->pinned;
+	}
+	else {
+		pstate_init_core(pos, &pstate);
+	}
 
 	if (!pstate.checkers) {
 		if (tthit && normal_eval(tteval) && ttbound & (tteval >= beta ? BOUND_LOWER : BOUND_UPPER))
@@ -375,12 +385,15 @@ static int32_t quiescence(struct position *pos, int ply, int32_t alpha, int32_t
 			alpha = best_eval;
 	}
 
+	pstate_init_extras(pos, &pstate);
+
 	move_t ttmove = pseudo_legal(pos, &pstate, &ttmove_unsafe)
 	                     && (is_capture(pos, &ttmove_unsafe) || move_flag(&ttmove_unsafe) == MOVE_PROMOTION)
 	                  ? ttmove_unsafe
 	                  : 0;
 	struct movepicker mp;
 	movepicker_init(&mp, 1, pos, &pstate, ttmove, 0, 0, 0, si, ss);
+	STAT(mp.stats = &si->stats);
 	move_t best_move = 0;
 	move_t move;
 	int move_index = -1;
@@ -447,12 +460,16 @@ int32_t negamax(struct position *pos, int depth, int ply, int32_t alpha, int32_t
 	if (si->sel_depth < ply)
 		si->sel_depth = ply;
 
+	/* The extras are computed after the pruning. */
 	struct pstate pstate;
-	pstate_init(pos, &pstate);
+	pstate_init_core(pos, &pstate);
 
 	if (depth <= 0 && !pstate.checkers)
 		return quiescence(pos, ply, alpha, beta, si, &pstate, ss);
 
+	/* Nodes handed to quiescence are counted there. */
+	STAT(si->stats.nodes[STATS_MAIN]++);
+
 	history_store(pos, si->history, ply);
 
 	int32_t eval = VALUE_NONE, best_eval = -VALUE_INFINITE;
@@ -495,12 +512,12 @@ int32_t negamax(struct position *pos, int depth, int ply, int32_t alpha, int32_t
 	int32_t ttstatic_eval   = tthit ? e->static_eval : VALUE_NONE;
 	move_t ttmove_unsafe    = root_node ? si->pv[0][0] : tthit ? e->move : 0;
 
+	STAT(si->stats.tt_probes[STATS_MAIN][ttbound]++);
 	if (!pv_node && tthit && !excluded_move && normal_eval(tteval) && ttdepth >= depth
-	    && ttbound & (tteval >= beta ? BOUND_LOWER : BOUND_UPPER))
+	    && ttbound & (tteval >= beta ? BOUND_LOWER : BOUND_UPPER)) {
+		STAT(si->stats.tt_cutoffs[STATS_MAIN]++);
 		return tteval;
-
-	move_t ttmove = pseudo_legal(pos, &pstate, &ttmove_unsafe) ? ttmove_unsafe : 0;
-	int ttcapture = ttmove ? is_capture(pos, &ttmove) : 0;
+	}
 
 	/* In the astronomically unlikely state that two positions zobirst keys
 	 * align, where the first position is in check, it is better to set
@@ -527,19 +544,26 @@ int32_t negamax(struct position *pos, int depth, int ply, int32_t alpha, int32_t
 
 	/* Razoring (37+-5 Elo). */
 	if (!pv_node && depth <= 8 && ss->eval + razor1 + razor2 * depth * depth < alpha) {
+		STAT(si->stats.razor_tries++);
 		eval = quiescence(pos, ply, alpha - 1, alpha, si, &pstate, ss);
-		if (eval < alpha)
+		if (eval < alpha) {
+			STAT(si->stats.razor_cutoffs++);
 			return eval;
+		}
 	}
 
 	/* Futility pruning (60+-8 Elo). */
+	STAT(si->stats.futility_tries += !pv_node && depth <= futility_depth);
 	if (!pv_node && depth <= futility_depth &&
 	    ss->eval - futility * depth + TUNECASTMULTIPLY(futility_improving, 256) * max(improvement, 0) / TUNEDIVIDE(256) >= beta &&
-	    ss->eval >= beta)
+	    ss->eval >= beta) {
+		STAT(si->stats.futility_cutoffs++);
 		return ss->eval;
+	}
 
 	/* Null move pruning (43+-6 Elo). */
 	if (!pv_node && (ss - 1)->move && ss->eval >= beta && depth >= 3 && has_sliding_piece(pos)) {
+		STAT(si->stats.null_tries++);
 		int reduction = 4;
 		int new_depth = clamp(depth - reduction, 1, depth);
 		int ep        = pos->en_passant;
@@ -550,14 +574,21 @@ int32_t negamax(struct position *pos, int depth, int ply, int32_t alpha, int32_t
 		eval = -negamax(pos, new_depth, ply + 1, -beta, -beta + 1, !cut_node, si, ss + 1);
 		do_null_zobrist_key(pos, ep);
 		do_null_move(pos, ep);
-		if (eval >= beta)
+		if (eval >= beta) {
+			STAT(si->stats.null_cutoffs++);
 			return beta;
+		}
 	}
 
 	if (!root_node && depth <= 0)
 		return quiescence(pos, ply, alpha, beta, si, &pstate, ss);
 
 skip_pruning:;
+	pstate_init_extras(pos, &pstate);
+
+	move_t ttmove       = pseudo_legal(pos, &pstate, &ttmove_unsafe) ? ttmove_unsafe : 0;
+	int ttcapture       = ttmove ? is_capture(pos, &ttmove) : 0;
+
 	move_t best_move    = 0;
 
 	move_t counter_move = 0;
@@ -568,6 +599,7 @@ skip_pruning:;
 	}
 	struct movepicker mp;
 	movepicker_init(&mp, 0, pos, &pstate, ttmove, si->killers[ply][0], si->killers[ply][1], counter_move, si, ss);
+	STAT(mp.stats = &si->stats);
 
 	move_t move, moves[MOVES_MAX], quiets[MOVES_MAX], captures[MOVES_MAX];
 	int n_moves = 0, n_quiets = 0, n_captures = 0;
@@ -596,6 +628,8 @@ skip_pruning:;
 
 			int32_t singular_beta = tteval - 2 * depth;
 
+			STAT(si->stats.singular_searches++);
+
 			ss->excluded_move     = move;
 			eval = negamax(pos, new_depth, ply, singular_beta - 1, singular_beta, cut_node, si, ss);
 			ss->excluded_move = 0;
@@ -607,8 +641,10 @@ skip_pruning:;
 			 * low on [singular_beta - 1, singular_beta] and ttmove is the
 			 * single best move by some margin.
 			 */
-			if (eval < singular_beta)
+			if (eval < singular_beta) {
+				STAT(si->stats.singular_extensions++);
 				extensions = 1;
+			}
 			/* Multi cut (6+-4 Elo).
 			 * Now eval >= singular_beta. If also singular_beta >= beta
 			 * we get the inequalities
@@ -616,8 +652,10 @@ skip_pruning:;
 			 * that fails high. We assume at least one move fails high
 			 * on a regular search and we thus return beta.
 			 */
-			else if (singular_beta >= beta && !pstate.checkers)
+			else if (singular_beta >= beta && !pstate.checkers) {
+				STAT(si->stats.singular_multicuts++);
 				return singular_beta;
+			}
 			/* We get the following inequalities,
 			 * singular_beta < beta <= tteval < exact_eval.
 			 */
@@ -664,12 +702,15 @@ skip_pruning:;
 			 * expect there to be a cut and it should suffice to search in [-alpha - 1, -alpha].
 			 */
 			eval = -negamax(pos, lmr_depth, ply + 1, -alpha - 1, -alpha, 1, si, ss + 1);
+			STAT(si->stats.lmr_searches += lmr_depth < new_depth);
 
 			/* If eval > alpha, then negamax < -alpha but we expected negamax >= -alpha. We
 			 * must therefore research this node.
 			 */
-			if (eval > alpha && new_depth > lmr_depth)
+			if (eval > alpha && new_depth > lmr_depth) {
+				STAT(si->stats.lmr_researches++);
 				full_depth_search = 1;
+			}
 		}
 		else {
 			/* If this is not a pv node, then alpha = beta + 1, or -beta = -alpha - 1.
@@ -715,10 +756,13 @@ skip_pruning:;
 				if (pv_node)
 					store_pv_move(&move, ply, si->pv);
 
-				if (pv_node && eval < beta)
+				if (pv_node && eval < beta) {
 					alpha = eval;
-				else
+				}
+				else {
+					STAT(si->stats.cutoffs[min(move_index, STATS_CUTOFF_INDICES - 1)]++);
 					break;
+				}
 			}
 		}
 		moves[n_moves++] = move;
@@ -785,6 +829,63 @@ static int32_t aspiration_window(struct position *pos, int depth, int verbose, i
 	return eval;
 }
 
+#ifdef STATS
+static double percent(uint64_t a, uint64_t b) { return b ? 100.0 * a / b : 0.0; }
+
+static void print_stats(const struct searchinfo *si) {
+	const struct searchstats *st = &si->stats;
+	const char *name[] = { "main", "qsearch" };
+
+	uint64_t nodes = st->nodes[STATS_MAIN] + st->nodes[STATS_QUIESCENCE];
+	printf("info string stats nodes main %" PRIu64 " qsearch %" PRIu64 " qsearch ratio %.1f%%\n",
+	       st->nodes[STATS_MAIN], st->nodes[STATS_QUIESCENCE], percent(st->nodes[STATS_QUIESCENCE], nodes));
+
+	for (int i = STATS_MAIN; i <= STATS_QUIESCENCE; i++) {
+		const uint64_t *p = st->tt_probes[i];
+		uint64_t probes   = p[0] + p[BOUND_LOWER] + p[BOUND_UPPER] + p[BOUND_EXACT];
+		printf("info string stats tt %s probes %" PRIu64 " miss %.1f%% exact %.1f%% lower %.1f%% upper %.1f%%"
+		       " cutoffs %.1f%%\n",
+		       name[i], probes, percent(p[0], probes), percent(p[BOUND_EXACT], probes),
+		       percent(p[BOUND_LOWER], probes), percent(p[BOUND_UPPER], probes), percent(st->tt_cutoffs[i], probes));
+	}
+
+	uint64_t cutoffs = 0;
+	for (int i = 0; i < STATS_CUTOFF_INDICES; i++)
+		cutoffs += st->cutoffs[i];
+	printf("info string stats cutoffs %" PRIu64 " by move", cutoffs);
+	for (int i = 0; i < STATS_CUTOFF_INDICES; i++)
+		printf(" %d%s %.1f%%", i + 1, i == STATS_CUTOFF_INDICES - 1 ? "+" : "", percent(st->cutoffs[i], cutoffs));
+	printf("\n");
+
+	printf("info string stats razoring %" PRIu64 " of %" PRIu64 " (%.1f%%)\n", st->razor_cutoffs, st->razor_tries,
+	       percent(st->razor_cutoffs, st->razor_tries));
+	printf("info string stats futility %" PRIu64 " of %" PRIu64 " (%.1f%%)\n", st->futility_cutoffs,
+	       st->futility_tries, percent(st->futility_cutoffs, st->futility_tries));
+	printf("info string stats nullmove %" PRIu64 " of %" PRIu64 " (%.1f%%)\n", st->null_cutoffs, st->null_tries,
+	       percent(st->null_cutoffs, st->null_tries));
+	printf("info string stats lmr researches %" PRIu64 " of %" PRIu64 " (%.1f%%)\n", st->lmr_researches,
+	       st->lmr_searches, percent(st->lmr_researches, st->lmr_searches));
+	printf("info string stats singular searches %" PRIu64 " extensions %.1f%% multicuts %.1f%%\n",
+	       st->singular_searches, percent(st->singular_extensions, st->singular_searches),
+	       percent(st->singular_multicuts, st->singular_searches));
+	uint64_t main = st->nodes[STATS_MAIN];
+	printf("info string stats comparisons sort %" PRIu64 " pick %" PRIu64 " (%.1f per node) quiet sort %" PRIu64
+	       " (%.1f per node)\n",
+	       st->sort_comparisons, st->pick_comparisons, main ? (double)st->pick_comparisons / main : 0.0,
+	       st->quiet_sort_comparisons, main ? (double)st->quiet_sort_comparisons / main : 0.0);
+
+	/* Effective branching factor of each iteration compared to the previous one. */
+	for (int d = 2; d <= si->done_depth; d++) {
+		if (!st->depth_nodes[d - 1])
+			continue;
+		uint64_t current  = st->depth_nodes[d] - st->depth_nodes[d - 1];
+		uint64_t previous = st->depth_nodes[d - 1] - st->depth_nodes[d - 2];
+		printf("info string stats depth %d nodes %" PRIu64 " ebf %.2f\n", d, current,
+		       previous ? (double)current / previous : 0.0);
+	}
+}
+#endif
+
 int32_t search(struct position *pos, int depth, int verbose, struct timeinfo *ti, move_t move[2],
                struct transpositiontable *tt, struct history *history, int iterative) {
 	assert(option_history == (history != NULL));
@@ -816,6 +917,9 @@ int32_t search(struct position *pos, int depth, int verbose, struct timeinfo *ti
 	if (!moves[0]) {
 		uint64_t checkers = generate_checkers(pos, pos->turn);
 		printf("info string %s\n", checkers ? "mate" : "draw");
+		time_term(si.ti);
+		ti->searched_nodes = 0;
+		ti->searched_depth = ti->searched_sel_depth = 0;
 		if (move)
 			move[0] = move[1] = 0;
 		return checkers ? -VALUE_MATE : 0;
@@ -858,6 +962,10 @@ int32_t search(struct position *pos, int depth, int verbose, struct timeinfo *ti
 		}
 
 		si.done_depth = d;
+		STAT(si.stats.depth_nodes[d] = si.nodes);
+
+		if (si.ti->iteration)
+			si.ti->iteration(si.ti, d, si.nodes, best_move);
 
 		if (verbose) {
 			has_previously_printed = 1;
@@ -868,6 +976,12 @@ int32_t search(struct position *pos, int depth, int verbose, struct timeinfo *ti
 			break;
 	}
 
+	time_term(si.ti);
+
+	ti->searched_nodes     = si.nodes;
+	ti->searched_depth     = si.done_depth;
+	ti->searched_sel_depth = si.sel_depth;
+
 	if (!best_move) {
 		best_move = moves[0];
 		char str[6];
@@ -877,6 +991,11 @@ int32_t search(struct position *pos, int depth, int verbose, struct timeinfo *ti
 	if (option_debug)
 		printf("info string nodes %" PRIu64 "\n", si.nodes);
 
+#ifdef STATS
+	if (verbose)
+		print_stats(&si);
+#endif
+
 	/* We are not allowed to exit the search before either a ponderhit
 	 * or stop command. Both of these commands will set uciponder to 0.
 	 */
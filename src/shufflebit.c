@@ -0,0 +1,313 @@
+/* bitbit, a bitboard based chess engine written in c.
+ * Copyright (C) 2022-2025 Isak Ellmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "util.h"
+
+/* Shuffles the games of any number of .bit files into a number of output
+ * files with bounded memory and only sequential reads and writes. The first
+ * pass appends every game to a random bucket, a temporary file small enough
+ * to fit in memory. The second pass reads one bucket at a time, shuffles its
+ * games and deals them to the output files in turn.
+ */
+
+#define BUCKETS_MAX 4096
+/* The write buffer of every bucket, which is counted in --memory. */
+#define BUCKET_BUFFER (16 * 1024)
+
+/* Returns the offset of the end of the game starting at offset, or 0 if the
+ * data is bad.
+ */
+static size_t game_end(const unsigned char *data, size_t size, int version, size_t offset) {
+	move_t move;
+	if (read_move_mem(data, &move, &offset, size) || move
+	    || (version == 1 ? read_position_mem(data, NULL, &offset, size)
+	                     : read_position2_mem(data, NULL, &offset, size))
+	    || read_result_mem(data, NULL, &offset, size))
+		return 0;
+	while (1) {
+		if ((version == 1 ? read_eval_mem(data, NULL, &offset, size) : read_eval2_mem(data, NULL, &offset, size))
+		    || read_flag_mem(data, NULL, &offset, size))
+			return 0;
+		size_t next = offset;
+		if (offset == size || (!read_move_mem(data, &move, &next, size) && !move))
+			return offset;
+		offset = next;
+	}
+}
+
+static FILE *open_bucket(const char *tmpdir) {
+	char *path = malloc(strlen(tmpdir) + 32);
+	sprintf(path, "%s/.shufflebit-XXXXXX", tmpdir);
+	int fd = mkstemp(path);
+	if (fd != -1)
+		unlink(path);
+	free(path);
+	FILE *f = fd != -1 ? fdopen(fd, "w+b") : NULL;
+	if (f)
+		setvbuf(f, NULL, _IOFBF, BUCKET_BUFFER);
+	return f;
+}
+
+/* Appends the games of path to random buckets. */
+static int distribute(const char *path, FILE **buckets, size_t buckets_num, int *version, uint64_t *seed,
+                      size_t *games) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st)) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		return 1;
+	}
+	size_t size               = st.st_size;
+	const unsigned char *data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "error: failed to map file '%s'\n", path);
+		return 1;
+	}
+	if (data)
+		madvise((void *)data, size, MADV_SEQUENTIAL);
+
+	int error = 0, file_version;
+	size_t offset = 0;
+	if (read_header_mem(data, &file_version, &offset, size)) {
+		fprintf(stderr, "error: bad header in file '%s'\n", path);
+		error = 1;
+	}
+	else if (*version && file_version != *version) {
+		fprintf(stderr, "error: file '%s' is of version %d and not %d\n", path, file_version, *version);
+		error = 1;
+	}
+	*version = file_version;
+
+	while (!error && offset < size) {
+		size_t end = game_end(data, size, file_version, offset);
+		if (!end) {
+			fprintf(stderr, "error: bad training data in file '%s' at byte offset %zu\n", path, offset);
+			error = 1;
+			break;
+		}
+		FILE *bucket = buckets[xorshift64(seed) % buckets_num];
+		if (fwrite(data + offset, 1, end - offset, bucket) != end - offset) {
+			fprintf(stderr, "error: failed to write bucket\n");
+			error = 1;
+		}
+		offset = end;
+		(*games)++;
+	}
+	if (data)
+		munmap((void *)data, size);
+	return error;
+}
+
+/* Shuffles the games of the bucket and deals them to the output files,
+ * continuing from output file *next.
+ */
+static int collect(FILE *bucket, int version, FILE **outs, int outs_num, int *next, uint64_t *seed) {
+	long size = ftell(bucket);
+	if (size <= 0)
+		return size < 0;
+	unsigned char *data = malloc(size);
+	if (!data || fflush(bucket) || fseek(bucket, 0, SEEK_SET) || fread(data, 1, size, bucket) != (size_t)size) {
+		free(data);
+		return 1;
+	}
+
+	int error        = 0;
+	size_t games_num = 0, games_size = 1024;
+	size_t *games    = malloc(games_size * sizeof(*games));
+	for (size_t offset = 0; offset < (size_t)size && !error;) {
+		if (games_num == games_size) {
+			games_size *= 2;
+			games       = realloc(games, games_size * sizeof(*games));
+		}
+		games[games_num++] = offset;
+		error              = !(offset = game_end(data, size, version, offset));
+	}
+
+	for (size_t k = games_num; k > 0 && !error; k--) {
+		size_t j     = xorshift64(seed) % k;
+		size_t begin = games[j];
+		size_t end   = game_end(data, size, version, begin);
+		error        = fwrite(data + begin, 1, end - begin, outs[*next]) != end - begin;
+		*next        = (*next + 1) % outs_num;
+		games[j]     = games[k - 1];
+	}
+	free(games);
+	free(data);
+	return error;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+	        "usage: %s [--shards n] [--memory n] [--seed n] [--tmpdir dir] --output prefix file...\n\n"
+	        "Shuffles the games of all files into the n files prefix-1.bit to prefix-n.bit,\n"
+	        "using about n MiB of memory.\n",
+	        name);
+}
+
+int main(int argc, char **argv) {
+	int shards         = 1;
+	long memory        = 1024;
+	uint64_t seed      = time(NULL);
+	const char *output = NULL, *tmpdir = NULL;
+	static struct option opts[] = {
+		{ "shards", required_argument, NULL, 'n' },
+		{ "memory", required_argument, NULL, 'm' },
+		{   "seed", required_argument, NULL, 's' },
+		{ "tmpdir", required_argument, NULL, 't' },
+		{ "output", required_argument, NULL, 'o' },
+		{     NULL,                 0, NULL,   0 },
+	};
+	char *endptr;
+	int c, option_index = 0;
+	int error = 0;
+	while ((c = getopt_long(argc, argv, "n:m:s:t:o:", opts, &option_index)) != -1) {
+		errno = 0;
+		switch (c) {
+		case 'n':
+			shards = strtol(optarg, &endptr, 10);
+			if (errno || *endptr || shards < 1 || shards > 1024)
+				error = 1;
+			break;
+		case 'm':
+			memory = strtol(optarg, &endptr, 10);
+			if (errno || *endptr || memory < 1)
+				error = 1;
+			break;
+		case 's':
+			seed = strtoull(optarg, &endptr, 10);
+			if (errno || *endptr || !seed)
+				error = 1;
+			break;
+		case 't':
+			tmpdir = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			error = 1;
+			break;
+		}
+	}
+	if (error || !output || optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* The buckets are kept in the directory of the output by default. */
+	char *dir   = strdup(output);
+	char *slash = strrchr(dir, '/');
+	if (slash)
+		*slash = '\0';
+	if (!tmpdir)
+		tmpdir = slash ? dir : ".";
+
+	/* The buckets are all open at once, next to the outputs and a few
+	 * other files, and their buffers are taken from the memory. Half of
+	 * what is left is for reading a bucket, with room to spare for buckets
+	 * that are larger than the average.
+	 */
+	size_t files_max = BUCKETS_MAX;
+	struct rlimit rl;
+	if (!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur != RLIM_INFINITY)
+		files_max = rl.rlim_cur < (rlim_t)shards + 16 ? 0
+		          : rl.rlim_cur - shards - 16 < files_max ? rl.rlim_cur - shards - 16
+		                                                   : files_max;
+
+	uint64_t total = 0;
+	for (int i = optind; i < argc; i++) {
+		struct stat st;
+		if (stat(argv[i], &st)) {
+			fprintf(stderr, "error: failed to open file '%s'\n", argv[i]);
+			return 2;
+		}
+		total += st.st_size;
+	}
+	uint64_t bytes     = (uint64_t)memory * 1024 * 1024;
+	size_t buckets_num = 1;
+	while (buckets_num <= files_max && buckets_num * BUCKET_BUFFER < bytes
+	       && buckets_num * ((bytes - buckets_num * BUCKET_BUFFER) / 2) <= total)
+		buckets_num++;
+	if (buckets_num > files_max || buckets_num * BUCKET_BUFFER >= bytes) {
+		fprintf(stderr,
+		        "error: %ld MiB of memory is not enough for %lu MiB of data in at most %zu buckets, "
+		        "raise --memory or the limit of open files\n",
+		        memory, (unsigned long)((total + (1 << 20) - 1) >> 20), files_max);
+		return 1;
+	}
+
+	FILE **buckets = calloc(buckets_num, sizeof(*buckets));
+	for (size_t i = 0; i < buckets_num; i++) {
+		if (!(buckets[i] = open_bucket(tmpdir))) {
+			fprintf(stderr, "error: failed to create bucket in directory '%s'\n", tmpdir);
+			return 3;
+		}
+	}
+
+	int version  = 0;
+	size_t games = 0;
+	for (int i = optind; i < argc; i++)
+		if (distribute(argv[i], buckets, buckets_num, &version, &seed, &games))
+			return 4;
+
+	FILE **outs = calloc(shards, sizeof(*outs));
+	char *path  = malloc(strlen(output) + 32);
+	for (int i = 0; i < shards; i++) {
+		sprintf(path, "%s-%d.bit", output, i + 1);
+		if (!(outs[i] = fopen(path, "wbx")) || write_header(outs[i], version)) {
+			fprintf(stderr, "error: failed to create file '%s'\n", path);
+			return 5;
+		}
+	}
+
+	int next = 0;
+	for (size_t i = 0; i < buckets_num; i++) {
+		if (collect(buckets[i], version, outs, shards, &next, &seed)) {
+			fprintf(stderr, "error: failed to shuffle bucket\n");
+			return 6;
+		}
+		fclose(buckets[i]);
+	}
+	for (int i = 0; i < shards; i++) {
+		if (fclose(outs[i])) {
+			sprintf(path, "%s-%d.bit", output, i + 1);
+			fprintf(stderr, "error: failed to write file '%s'\n", path);
+			return 5;
+		}
+	}
+
+	printf("shuffled %zu games into %d files using %zu buckets\n", games, shards, buckets_num);
+	free(path);
+	free(outs);
+	free(buckets);
+	free(dir);
+	return 0;
+}
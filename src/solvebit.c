@@ -0,0 +1,384 @@
+/* bitbit, a bitboard based chess engine written in c.
+ * Copyright (C) 2022-2025 Isak Ellmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "attackgen.h"
+#include "bitboard.h"
+#include "endgame.h"
+#include "history.h"
+#include "magicbitboard.h"
+#include "move.h"
+#include "movegen.h"
+#include "moveorder.h"
+#include "nnue.h"
+#include "option.h"
+#include "position.h"
+#include "search.h"
+#include "timeman.h"
+#include "transposition.h"
+#include "util.h"
+
+#define EPD_MOVES_MAX 16
+
+struct problem {
+	char fen[128];
+	char id[64];
+
+	move_t bm[EPD_MOVES_MAX];
+	move_t am[EPD_MOVES_MAX];
+	int bm_num, am_num;
+
+	/* The best move has been correct since depth, nodes and time. */
+	int found;
+	int depth;
+	uint64_t nodes;
+	timepoint_t time;
+
+	move_t move;
+	int searched_depth;
+	uint64_t searched_nodes;
+	timepoint_t searched_time;
+};
+
+static struct problem *problems;
+static size_t problems_num;
+static atomic_size_t next_problem;
+
+static int search_depth        = 0;
+static int64_t search_movetime = 0;
+static int64_t search_nodes    = 0;
+static int64_t tt_MiB          = 64;
+static int verbose             = 0;
+
+static pthread_mutex_t outmutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int is_correct(const struct problem *p, move_t move) {
+	if (!move)
+		return 0;
+	for (int i = 0; i < p->am_num; i++)
+		if (move_compare(p->am[i], move))
+			return 0;
+	for (int i = 0; i < p->bm_num; i++)
+		if (move_compare(p->bm[i], move))
+			return 1;
+	return !p->bm_num;
+}
+
+static void iteration(struct timeinfo *ti, int depth, uint64_t nodes, move_t best_move) {
+	struct problem *p = ti->data;
+	if (!is_correct(p, best_move)) {
+		p->found = 0;
+	}
+	else if (!p->found) {
+		p->found = 1;
+		p->depth = depth;
+		p->nodes = nodes;
+		p->time  = time_since(ti);
+	}
+}
+
+static void print_problem(const struct problem *p) {
+	char str[8];
+	struct position pos;
+	pos_from_fen2(&pos, p->fen);
+	const char *move = p->move ? move_str_pgn(str, &pos, &p->move) : NULL;
+	if (p->found)
+		printf("%-24s solved depth %3d nodes %12" PRIu64 " time %8" PRId64 " ms move %s\n", p->id, p->depth,
+		       p->nodes, p->time / TPPERMS, move ? move : "none");
+	else
+		printf("%-24s failed depth %3d nodes %12" PRIu64 " time %8" PRId64 " ms move %s\n", p->id,
+		       p->searched_depth, p->searched_nodes, p->searched_time / TPPERMS, move ? move : "none");
+}
+
+static void *solve_thread(void *arg) {
+	UNUSED(arg);
+	struct transpositiontable tt;
+	if (transposition_alloc(&tt, tt_MiB * 1024 * 1024)) {
+		fprintf(stderr, "error: failed to allocate transposition table\n");
+		exit(1);
+	}
+
+	struct position pos;
+	struct history h;
+	size_t i;
+	while ((i = atomic_fetch_add(&next_problem, 1)) < problems_num) {
+		struct problem *p = &problems[i];
+		pos_from_fen2(&pos, p->fen);
+		history_reset(&pos, &h);
+		transposition_clear(&tt);
+
+		struct timeinfo ti = {
+			.nodes        = search_nodes,
+			.movetime     = search_movetime * TPPERMS,
+			.stop_on_time = search_movetime > 0,
+			.iteration    = &iteration,
+			.data         = p,
+		};
+		move_t move[2];
+
+		search(&pos, search_depth, 0, &ti, move, &tt, &h, 1);
+
+		p->move           = move[0];
+		p->searched_depth = ti.searched_depth;
+		p->searched_nodes = ti.searched_nodes;
+		p->searched_time  = time_since(&ti);
+		/* The final move can come from an unfinished iteration. */
+		if (!is_correct(p, p->move))
+			p->found = 0;
+
+		if (verbose) {
+			pthread_mutex_lock(&outmutex);
+			print_problem(p);
+			pthread_mutex_unlock(&outmutex);
+		}
+	}
+
+	transposition_free(&tt);
+	return NULL;
+}
+
+/* Accepts both standard notation with or without check annotations and long
+ * algebraic notation.
+ */
+static move_t epd_move(const struct position *pos, const char *token) {
+	char str[16];
+	snprintf(str, sizeof(str), "%s", token);
+	str[strcspn(str, "!?")] = '\0';
+
+	move_t move;
+	if ((move = string_to_move(pos, str)))
+		return move;
+
+	size_t len = strlen(str);
+	if (len + 1 >= sizeof(str))
+		return 0;
+	str[len + 1] = '\0';
+	str[len]     = '+';
+	if ((move = string_to_move(pos, str)))
+		return move;
+	str[len] = '#';
+	if ((move = string_to_move(pos, str)))
+		return move;
+
+	str[len] = '\0';
+	if (len && (str[len - 1] == '+' || str[len - 1] == '#')) {
+		str[len - 1] = '\0';
+		return string_to_move(pos, str);
+	}
+	return 0;
+}
+
+static int parse_epd(struct problem *p, char *line, size_t n) {
+	memset(p, 0, sizeof(*p));
+
+	char *ops = line;
+	for (int fields = 0; fields < 4; fields++) {
+		ops = strchr(ops, ' ');
+		if (!ops)
+			return 1;
+		ops++;
+	}
+	ops[-1] = '\0';
+	snprintf(p->fen, sizeof(p->fen), "%s", line);
+	if (!fen_is_ok2(p->fen))
+		return 1;
+	snprintf(p->id, sizeof(p->id), "%zu", n);
+
+	struct position pos;
+	pos_from_fen2(&pos, p->fen);
+
+	char *saveptr;
+	for (char *op = strtok_r(ops, ";", &saveptr); op; op = strtok_r(NULL, ";", &saveptr)) {
+		op += strspn(op, " \t");
+		if (!strncmp(op, "id ", 3)) {
+			char *id = op + 3 + strspn(op + 3, " \t\"");
+			snprintf(p->id, sizeof(p->id), "%.*s", (int)strcspn(id, "\""), id);
+		}
+		else if (!strncmp(op, "bm ", 3) || !strncmp(op, "am ", 3)) {
+			int am        = op[0] == 'a';
+			move_t *moves = am ? p->am : p->bm;
+			int *num      = am ? &p->am_num : &p->bm_num;
+			char *saveptr2;
+			for (char *token = strtok_r(op + 3, " \t", &saveptr2); token;
+			     token       = strtok_r(NULL, " \t", &saveptr2)) {
+				move_t move = epd_move(&pos, token);
+				if (!move || *num >= EPD_MOVES_MAX)
+					return 1;
+				moves[(*num)++] = move;
+			}
+		}
+	}
+
+	return !p->bm_num && !p->am_num;
+}
+
+static void read_epd(const char *path) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "error: failed to open file '%s'\n", path);
+		exit(2);
+	}
+
+	size_t size = 0, n = 0;
+	char line[BUFSIZ];
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '\0' || line[0] == '#')
+			continue;
+		if (problems_num == size) {
+			size     = size ? 2 * size : 64;
+			problems = realloc(problems, size * sizeof(*problems));
+		}
+		if (parse_epd(&problems[problems_num], line, n)) {
+			fprintf(stderr, "error: bad epd on line %zu of file '%s'\n", n, path);
+			exit(3);
+		}
+		problems_num++;
+	}
+	fclose(f);
+}
+
+static int parse_int(const char *arg, const char *name, int64_t *value, int64_t min) {
+	char *endptr;
+	errno  = 0;
+	*value = strtoll(arg, &endptr, 10);
+	if (errno || *endptr != '\0' || *value < min) {
+		fprintf(stderr, "error: bad argument: %s\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int64_t jobs = 1, d = 0;
+	static struct option opts[] = {
+		{  "verbose",       no_argument, NULL, 'v' },
+		{     "jobs", required_argument, NULL, 'j' },
+		{ "movetime", required_argument, NULL, 't' },
+		{    "nodes", required_argument, NULL, 'n' },
+		{    "depth", required_argument, NULL, 'd' },
+		{       "tt", required_argument, NULL, 'T' },
+		{       NULL,                 0, NULL,   0 },
+	};
+
+	int c, option_index = 0;
+	int error = 0;
+	while ((c = getopt_long(argc, argv, "vj:t:n:d:T:", opts, &option_index)) != -1) {
+		switch (c) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 'j':
+			error |= parse_int(optarg, "jobs", &jobs, 1);
+			break;
+		case 't':
+			error |= parse_int(optarg, "movetime", &search_movetime, 1);
+			break;
+		case 'n':
+			error |= parse_int(optarg, "nodes", &search_nodes, 1);
+			break;
+		case 'd':
+			error |= parse_int(optarg, "depth", &d, 1);
+			break;
+		case 'T':
+			error |= parse_int(optarg, "tt", &tt_MiB, 1);
+			break;
+		default:
+			error = 1;
+			break;
+		}
+	}
+	if (error)
+		return 1;
+	if (optind + 1 != argc) {
+		fprintf(stderr, "usage: %s [-v] [-j jobs] [-t movetime | -n nodes | -d depth] [-T tt] file\n", argv[0]);
+		return 1;
+	}
+	search_depth = d > PLY_MAX / 2 ? PLY_MAX / 2 : d;
+	if (!search_movetime && !search_nodes && !search_depth)
+		search_movetime = 1000;
+
+	option_transposition = 1;
+	option_history       = 1;
+
+	magicbitboard_init();
+	attackgen_init();
+	bitboard_init();
+	search_init();
+	moveorder_init();
+	position_init();
+	transposition_init();
+	endgame_init();
+	history_init();
+	nnue_init();
+
+	read_epd(argv[optind]);
+
+	pthread_t *thread = malloc(jobs * sizeof(*thread));
+	pthread_attr_t attr;
+	if (pthread_attr_init(&attr) || pthread_attr_setstacksize(&attr, 8 * 1024 * 1024)) {
+		fprintf(stderr, "error: failed to create thread\n");
+		return 4;
+	}
+
+	timepoint_t start = time_now();
+	for (int i = 0; i < jobs; i++) {
+		if (pthread_create(&thread[i], &attr, &solve_thread, NULL)) {
+			fprintf(stderr, "error: failed to create thread\n");
+			return 4;
+		}
+	}
+	for (int i = 0; i < jobs; i++)
+		pthread_join(thread[i], NULL);
+	timepoint_t total_time = time_now() - start;
+
+	size_t solved        = 0;
+	uint64_t sum_nodes   = 0;
+	timepoint_t sum_time = 0;
+	int64_t sum_depth    = 0;
+	for (size_t i = 0; i < problems_num; i++) {
+		const struct problem *p = &problems[i];
+		if (!verbose)
+			print_problem(p);
+		if (p->found) {
+			solved++;
+			sum_nodes += p->nodes;
+			sum_time  += p->time;
+			sum_depth += p->depth;
+		}
+	}
+
+	printf("solved: %zu/%zu\n", solved, problems_num);
+	printf("nodes to solution: %" PRIu64 "\n", sum_nodes);
+	printf("time to solution: %" PRId64 " ms\n", sum_time / TPPERMS);
+	printf("depth to solution: %.2f\n", solved ? (double)sum_depth / solved : 0.0);
+	printf("time: %" PRId64 " ms\n", total_time / TPPERMS);
+
+	pthread_attr_destroy(&attr);
+	free(thread);
+	free(problems);
+}
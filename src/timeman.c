@@ -14,11 +14,12 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#define _POSIX_C_SOURCE 199309L
+#define _POSIX_C_SOURCE 200809L
 #include "timeman.h"
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
 #include "option.h"
@@ -29,11 +30,54 @@ TUNEVAR(double, maximal, 0.8, 0.02, 0.98)
 TUNEVAR(double, instability1, 0.5, 0.0, NULL)
 TUNEVAR(double, instability2, 1.1, 0.0, NULL)
 
+static void *timer_thread(void *arg) {
+	struct timeinfo *ti = arg;
+	pthread_mutex_lock(&ti->mutex);
+	while (!ti->timer_done) {
+		timepoint_t left = ti->maximal - time_since(ti);
+		if (left <= 0) {
+			if (!atomic_load_explicit(&uciponder, memory_order_relaxed)) {
+				atomic_store_explicit(&ti->timeout, 1, memory_order_relaxed);
+				break;
+			}
+			/* We are not allowed to stop while pondering, but the
+			 * time has already run out in case of a ponderhit.
+			 */
+			left = TPPERMS;
+		}
+
+		/* pthread_cond_timedwait takes an absolute time of the
+		 * realtime clock. We always recompute what is left using
+		 * the monotonic clock after waking up.
+		 */
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		timepoint_t deadline = (timepoint_t)ts.tv_sec * TPPERSEC + ts.tv_nsec + left;
+		ts.tv_sec            = deadline / TPPERSEC;
+		ts.tv_nsec           = deadline % TPPERSEC;
+		pthread_cond_timedwait(&ti->cond, &ti->mutex, &ts);
+	}
+	pthread_mutex_unlock(&ti->mutex);
+	return NULL;
+}
+
+static void timer_start(struct timeinfo *ti) {
+	ti->timer_done = 0;
+	if (pthread_mutex_init(&ti->mutex, NULL) || pthread_cond_init(&ti->cond, NULL)
+	    || pthread_create(&ti->timer, NULL, &timer_thread, ti)) {
+		fprintf(stderr, "error: failed to create timer thread\n");
+		exit(4);
+	}
+	ti->timer_running = 1;
+}
+
 void time_init(struct position *pos, struct timeinfo *ti) {
 	if (!ti)
 		return;
 
 	ti->start = time_now();
+	atomic_store_explicit(&ti->timeout, 0, memory_order_relaxed);
+	ti->timer_running = 0;
 
 	if (!ti->stop_on_time)
 		ti->stop_on_time = ti->movetime || ti->etime[0] || ti->etime[1] || ti->einc[0] || ti->einc[1];
@@ -42,6 +86,7 @@ void time_init(struct position *pos, struct timeinfo *ti) {
 
 	if (ti->movetime) {
 		ti->optimal = ti->maximal = ti->movetime;
+		timer_start(ti);
 		return;
 	}
 
@@ -63,6 +108,26 @@ void time_init(struct position *pos, struct timeinfo *ti) {
 		time_left    = ti->etime[them] + ti->movestogo * ti->einc[them];
 		ti->optimal += min(ti->optimal / 4, time_left / (2 * ti->movestogo));
 	}
+
+	timer_start(ti);
+}
+
+void time_term(struct timeinfo *ti) {
+	if (!ti || !ti->timer_running)
+		return;
+
+	pthread_mutex_lock(&ti->mutex);
+	ti->timer_done = 1;
+	pthread_cond_signal(&ti->cond);
+	pthread_mutex_unlock(&ti->mutex);
+
+	if (pthread_join(ti->timer, NULL)) {
+		fprintf(stderr, "error: pthread_join\n");
+		exit(5);
+	}
+	pthread_mutex_destroy(&ti->mutex);
+	pthread_cond_destroy(&ti->cond);
+	ti->timer_running = 0;
 }
 
 int stop_searching(struct timeinfo *ti, move_t best_move) {
@@ -16,6 +16,10 @@
 #include "test_sse.c"
 #include "test_endgame.c"
 #include "test_movepicker.c"
+#include "test_magic.c"
+#include "test_bitbase.c"
+#include "test_io.c"
+#include "test_move.c"
 
 int main(void) {
 	magicbitboard_init();
@@ -67,6 +71,24 @@ int main(void) {
 	CU_add_test(pSuite, "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", test_movepicker_5);
 	CU_add_test(pSuite, "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", test_movepicker_6);
 
+	pSuite = CU_add_suite("Magic bitboards", NULL, NULL);
+	CU_add_test(pSuite, "Magic numbers", test_magic_numbers);
+	CU_add_test(pSuite, "Slider attacks", test_magic_attacks);
+
+	pSuite = CU_add_suite("Bitbases", NULL, NULL);
+	CU_add_test(pSuite, "Bitbase names", test_bitbase_parse);
+	CU_add_test(pSuite, "Bitbase index", test_bitbase_index);
+	CU_add_test(pSuite, "Builtin bitbases", test_bitbase_builtin);
+
+	pSuite = CU_add_suite("Training data", NULL, NULL);
+	CU_add_test(pSuite, "Version 1", test_io_version_1);
+	CU_add_test(pSuite, "Version 2", test_io_version_2);
+	CU_add_test(pSuite, "Game index", test_io_bitindex);
+	CU_add_test(pSuite, "Buffered writer", test_io_bitwriter);
+
+	pSuite = CU_add_suite("Moves", NULL, NULL);
+	CU_add_test(pSuite, "Standard algebraic notation", test_move_san);
+
 	CU_basic_set_mode(CU_BRM_NORMAL);
 	CU_basic_run_tests();
 	CU_basic_show_failures(CU_get_failure_list());
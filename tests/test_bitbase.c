@@ -0,0 +1,118 @@
+#include "bitbase.h"
+
+static const char *bitbase_names[] = { "KK", "KPK", "KPKP", "KRKN", "KBBKN", "KRPKR", "KPPKP" };
+
+/* Sets up the position of index with white as the first side and returns
+ * whether it is the canonical position of its index.
+ */
+static int bitbase_test_position(struct position *pos, const struct bitbase *bb, long index) {
+	int turn;
+	int squares[2][BITBASE_PIECES_MAX + 1];
+	bitbase_squares(bb, index, &turn, squares);
+	memset(pos, 0, sizeof(*pos));
+	pos->turn = turn;
+	for (int side = 0; side < 2; side++) {
+		int color = side ? BLACK : WHITE;
+		for (int i = 0; i <= bb->pieces_num[side]; i++) {
+			int piece  = i ? bb->pieces[side][i - 1] : KING;
+			int square = squares[side][i];
+			if (pos->mailbox[square]
+			    || (i > 1 && piece == bb->pieces[side][i - 2] && square < squares[side][i - 1]))
+				return 0;
+			pos->piece[color][piece] |= bitboard(square);
+			pos->piece[color][ALL]   |= bitboard(square);
+			pos->mailbox[square]      = colored_piece(piece, color);
+		}
+	}
+	return 1;
+}
+
+static void bitbase_test_flip(struct position *flipped, const struct position *pos, int colors, int files) {
+	memset(flipped, 0, sizeof(*flipped));
+	flipped->turn = colors ? other_color(pos->turn) : pos->turn;
+	for (int color = 0; color < 2; color++) {
+		for (int piece = ALL; piece <= KING; piece++) {
+			uint64_t b = pos->piece[color][piece];
+			while (b) {
+				int square = ctz(b) ^ (colors ? 0x38 : 0) ^ (files ? 0x7 : 0);
+				flipped->piece[colors ? other_color(color) : color][piece] |= bitboard(square);
+				b = clear_ls1b(b);
+			}
+		}
+	}
+}
+
+static void test_bitbase_parse(void) {
+	struct bitbase bb;
+	CU_ASSERT_EQUAL(bitbase_parse(&bb, "KPKR"), 0);
+	CU_ASSERT(!strcmp(bb.name, "KRKP"));
+	CU_ASSERT_EQUAL(bitbase_parse(&bb, "KPRKR"), 0);
+	CU_ASSERT(!strcmp(bb.name, "KRPKR"));
+	CU_ASSERT_EQUAL(bb.size, 2l * 32 * 64 * 64 * 48 * 64);
+	CU_ASSERT_EQUAL(bitbase_parse(&bb, "KNKNN"), 0);
+	CU_ASSERT(!strcmp(bb.name, "KNNKN"));
+	CU_ASSERT(bitbase_parse(&bb, "KRR"));
+	CU_ASSERT(bitbase_parse(&bb, "KRKKR"));
+	CU_ASSERT(bitbase_parse(&bb, "KQRBKN"));
+	CU_ASSERT(bitbase_parse(&bb, "KXK"));
+}
+
+static void test_bitbase_index(void) {
+	uint64_t state = 1;
+	struct position pos, flipped;
+	struct bitbase bb;
+	for (size_t n = 0; n < SIZE(bitbase_names); n++) {
+		CU_ASSERT_FATAL(!bitbase_parse(&bb, bitbase_names[n]));
+		for (int i = 0; i < 4096; i++) {
+			long index = xorshift64(&state) % bb.size;
+			if (!bitbase_test_position(&pos, &bb, index))
+				continue;
+			CU_ASSERT_EQUAL(bitbase_side(&bb, &pos), WHITE);
+			CU_ASSERT_EQUAL(bitbase_index(&bb, &pos, WHITE), index);
+
+			/* Mirrored positions and positions with the colors
+			 * reversed share the same index.
+			 */
+			for (int flip = 1; flip < 4; flip++) {
+				int colors = flip & 1;
+				bitbase_test_flip(&flipped, &pos, colors, flip & 2);
+				int white_side = colors ? BLACK : WHITE;
+				CU_ASSERT_EQUAL(bitbase_index(&bb, &flipped, white_side), index);
+				if (strcmp(bb.name, "KK") && strcmp(bb.name, "KPKP"))
+					CU_ASSERT_EQUAL(bitbase_side(&bb, &flipped), white_side);
+			}
+		}
+	}
+}
+
+/* The runs of every block of the builtin bitbases add up to exactly one
+ * block.
+ */
+static int bitbase_test_blocks(const uint32_t *table, long blocks) {
+	const uint32_t *runs = table + blocks;
+	for (long block = 0; block + 1 < blocks; block++) {
+		long length = 0;
+		for (long offset = table[block]; offset < table[block + 1]; offset++)
+			length += ((runs[offset / 4] >> (8 * (offset % 4))) & 0x3F) + 1;
+		if (length != BITBASE_BLOCK_SIZE)
+			return 0;
+	}
+	return 1;
+}
+
+static void test_bitbase_builtin(void) {
+	CU_ASSERT(bitbase_test_blocks(bitbase_KPK, BITBASE_KPK_BLOCKS));
+	CU_ASSERT(bitbase_test_blocks(bitbase_KPKP, BITBASE_KPKP_BLOCKS));
+	CU_ASSERT(bitbase_test_blocks(bitbase_KRKP, BITBASE_KRKP_BLOCKS));
+
+	struct position pos;
+	pos_from_fen2(&pos, "8/8/8/8/8/4k3/4P3/4K3 w - - 0 1");
+	CU_ASSERT_EQUAL(bitbase_KPK_probe(&pos, WHITE), BITBASE_DRAW);
+	pos_from_fen2(&pos, "8/8/8/8/8/4k3/4P3/4K3 b - - 0 1");
+	CU_ASSERT_EQUAL(bitbase_KPK_probe(&pos, BLACK), BITBASE_DRAW);
+	pos_from_fen2(&pos, "8/8/8/8/4k3/8/4P3/4K3 w - - 0 1");
+	CU_ASSERT_EQUAL(bitbase_KPK_probe(&pos, BLACK), BITBASE_DRAW);
+	pos_from_fen2(&pos, "8/4P3/4K3/8/8/8/8/k7 b - - 0 1");
+	CU_ASSERT_EQUAL(bitbase_KPK_probe(&pos, WHITE), BITBASE_WIN);
+	CU_ASSERT_EQUAL(bitbase_KPK_probe(&pos, BLACK), BITBASE_LOSE);
+}
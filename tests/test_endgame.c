@@ -24,7 +24,8 @@ static void generate_material(int (*pieces)[7], size_t *length, int *counts, int
 static void material_position(struct position *pos, const int *white, const int *black) {
 	const int *pieces[2]   = { white, black };
 	pos->piece[WHITE][ALL] = pos->piece[BLACK][ALL] = 0;
-	int total = 0;
+	/* Start on rank 2, so that pawns index the builtin bitbases in bounds. */
+	int total = 8;
 	for (int color = 0; color < 2; color++) {
 		for (int piece = PAWN; piece <= KING; piece++) {
 			pos->piece[color][piece]   = (1 << pieces[color][piece]) - 1;
@@ -0,0 +1,194 @@
+#include "io.h"
+
+static const char *io_fens[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 b - - 17 300",
+	"8/8/8/8/8/4k3/4P3/4K3 w - - 99 65535",
+};
+
+static const int32_t io_evals[] = { 0, 1, -1, 63, -64, 64, 8191, -8192, 8192, VALUE_INFINITE, -VALUE_INFINITE, VALUE_NONE };
+
+/* Writes a game start for every position and evaluation and reads it back
+ * both from the file and from memory.
+ */
+static void io_test_version(int version) {
+	struct position pos[SIZE(io_fens)], read;
+	FILE *f = tmpfile();
+	CU_ASSERT_FATAL(f != NULL);
+	CU_ASSERT(!write_header(f, version));
+	for (size_t i = 0; i < SIZE(io_fens); i++) {
+		pos_from_fen2(&pos[i], io_fens[i]);
+		for (size_t j = 0; j < SIZE(io_evals); j++) {
+			CU_ASSERT(!write_move(f, 0));
+			CU_ASSERT(!(version == 1 ? write_position(f, &pos[i]) : write_position2(f, &pos[i])));
+			CU_ASSERT(!write_result(f, RESULT_DRAW));
+			CU_ASSERT(!(version == 1 ? write_eval(f, io_evals[j]) : write_eval2(f, io_evals[j])));
+			CU_ASSERT(!write_flag(f, FLAG_SKIP));
+		}
+	}
+
+	long size           = ftell(f);
+	unsigned char *data = malloc(size);
+	rewind(f);
+	CU_ASSERT(fread(data, 1, size, f) == (size_t)size);
+	rewind(f);
+
+	int file_version, mem_version;
+	size_t index = 0;
+	CU_ASSERT(!read_header(f, &file_version));
+	CU_ASSERT(!read_header_mem(data, &mem_version, &index, size));
+	CU_ASSERT_EQUAL(file_version, version);
+	CU_ASSERT_EQUAL(mem_version, version);
+	CU_ASSERT_EQUAL((long)index, ftell(f));
+
+	move_t move;
+	signed char result;
+	int32_t eval;
+	unsigned char flag;
+	for (size_t i = 0; i < SIZE(io_fens); i++) {
+		for (size_t j = 0; j < SIZE(io_evals); j++) {
+			CU_ASSERT(!read_move(f, &move) && !move);
+			CU_ASSERT(!(version == 1 ? read_position(f, &read) : read_position2(f, &read)));
+			CU_ASSERT(!poscmp(&pos[i], &read, 0));
+			CU_ASSERT(!read_result(f, &result) && result == RESULT_DRAW);
+			CU_ASSERT(!(version == 1 ? read_eval(f, &eval) : read_eval2(f, &eval)) && eval == io_evals[j]);
+			CU_ASSERT(!read_flag(f, &flag) && flag == FLAG_SKIP);
+
+			CU_ASSERT(!read_move_mem(data, &move, &index, size) && !move);
+			CU_ASSERT(!(version == 1 ? read_position_mem(data, &read, &index, size)
+			                         : read_position2_mem(data, &read, &index, size)));
+			CU_ASSERT(!poscmp(&pos[i], &read, 0));
+			CU_ASSERT(!read_result_mem(data, &result, &index, size) && result == RESULT_DRAW);
+			CU_ASSERT(!(version == 1 ? read_eval_mem(data, &eval, &index, size)
+			                         : read_eval2_mem(data, &eval, &index, size))
+			          && eval == io_evals[j]);
+			CU_ASSERT(!read_flag_mem(data, &flag, &index, size) && flag == FLAG_SKIP);
+		}
+	}
+	CU_ASSERT_EQUAL((long)index, size);
+	CU_ASSERT(read_move(f, &move));
+
+	free(data);
+	fclose(f);
+}
+
+static void test_io_version_1(void) { io_test_version(1); }
+
+static void test_io_version_2(void) { io_test_version(2); }
+
+static void test_io_bitindex(void) {
+	struct position pos;
+	struct bitindex bi;
+	startpos(&pos);
+	FILE *f = tmpfile();
+	CU_ASSERT_FATAL(f != NULL);
+	CU_ASSERT(!write_header(f, 2));
+	long offsets[3];
+	for (int game = 0; game < 3; game++) {
+		offsets[game] = ftell(f);
+		write_move(f, 0);
+		write_position2(f, &pos);
+		write_result(f, game - 1);
+		for (int ply = 0; ply <= game; ply++) {
+			if (ply)
+				write_move(f, new_move(ply % 2 ? 12 : 52, ply % 2 ? 20 : 44, 0, 0));
+			write_eval2(f, ply);
+			write_flag(f, 0);
+		}
+	}
+
+	long size           = ftell(f);
+	unsigned char *data = malloc(size);
+	rewind(f);
+	CU_ASSERT(fread(data, 1, size, f) == (size_t)size);
+	fclose(f);
+
+	CU_ASSERT(!bitindex_build_mem(&bi, data, size));
+	CU_ASSERT_EQUAL(bi.version, 2);
+	CU_ASSERT_EQUAL(bi.games_num, 3);
+	for (size_t game = 0; game < bi.games_num; game++) {
+		CU_ASSERT_EQUAL(bi.offsets[game], (uint64_t)offsets[game]);
+		CU_ASSERT_EQUAL(bi.plies[game], game + 1);
+		CU_ASSERT_EQUAL(bi.results[game], (int)game - 1);
+	}
+	bitindex_free(&bi);
+
+	/* Truncated records are rejected. */
+	CU_ASSERT(bitindex_build_mem(&bi, data, size - 1));
+	bitindex_free(&bi);
+
+	/* A saved sidecar is only loaded for the data it was saved for. */
+	const char *path = "test_bitindex.bit";
+	f                = fopen(path, "wb");
+	CU_ASSERT_FATAL(f != NULL);
+	CU_ASSERT(fwrite(data, 1, size, f) == (size_t)size);
+	fclose(f);
+	CU_ASSERT(!bitindex_build_mem(&bi, data, size));
+	CU_ASSERT(!bitindex_save(&bi, path));
+	bitindex_free(&bi);
+	CU_ASSERT(!bitindex_load(&bi, path, data, size));
+	CU_ASSERT_EQUAL(bi.games_num, 3);
+	for (size_t game = 0; game < bi.games_num; game++)
+		CU_ASSERT_EQUAL(bi.offsets[game], (uint64_t)offsets[game]);
+	bitindex_free(&bi);
+	CU_ASSERT(bitindex_load(&bi, path, data, size - 1));
+	data[offsets[2]] = 1;
+	CU_ASSERT(bitindex_load(&bi, path, data, size));
+	data[offsets[2]] = 0;
+	data[0]          = 'x';
+	CU_ASSERT(bitindex_load(&bi, path, data, size));
+	remove(path);
+	remove("test_bitindex.bit.idx");
+	free(data);
+}
+
+/* The buffered writer writes the same bytes as the unbuffered functions. */
+static void test_io_bitwriter(void) {
+	const char *path = "test_bitwriter.bit";
+	struct position pos;
+	pos_from_fen2(&pos, io_fens[1]);
+	move_t moves[]        = { new_move(12, 20, 0, 0), new_move(52, 44, 0, 0) };
+	int32_t evals[]       = { 12, -300, VALUE_NONE };
+	unsigned char flags[] = { 0, FLAG_SKIP, 0 };
+
+	for (int version = 1; version <= BIT_VERSION; version++) {
+		FILE *f = tmpfile();
+		CU_ASSERT_FATAL(f != NULL);
+		write_header(f, version);
+		for (int game = 0; game < 3; game++) {
+			write_move(f, 0);
+			version == 1 ? write_position(f, &pos) : write_position2(f, &pos);
+			write_result(f, RESULT_WIN);
+			for (int i = 0; i <= 2; i++) {
+				version == 1 ? write_eval(f, evals[i]) : write_eval2(f, evals[i]);
+				write_flag(f, flags[i]);
+				if (i < 2)
+					write_move(f, moves[i]);
+			}
+		}
+
+		struct bitwriter w;
+		int error = bitwriter_open(&w, path, version);
+		CU_ASSERT_FATAL(!error);
+		for (int game = 0; game < 3; game++)
+			CU_ASSERT(!bitwriter_game(&w, &pos, RESULT_WIN, 2, moves, evals, flags));
+		CU_ASSERT_EQUAL(w.games, 3);
+		CU_ASSERT_EQUAL((long)w.size, ftell(f));
+		CU_ASSERT(!bitwriter_close(&w));
+
+		FILE *g = fopen(path, "rb");
+		CU_ASSERT_FATAL(g != NULL);
+		rewind(f);
+		int c, d;
+		do {
+			c = fgetc(f);
+			d = fgetc(g);
+		} while (c == d && c != EOF);
+		CU_ASSERT_EQUAL(c, d);
+		fclose(g);
+		fclose(f);
+		remove(path);
+	}
+}
@@ -0,0 +1,34 @@
+#include "magicbitboard.h"
+
+static void test_magic_numbers(void) {
+	for (int square = 0; square < 64; square++) {
+		CU_ASSERT_EQUAL(bishop_magic[square].magic, magic_find(square, BISHOP));
+		CU_ASSERT_EQUAL(rook_magic[square].magic, magic_find(square, ROOK));
+	}
+}
+
+static void test_magic_attacks(void) {
+	uint64_t state = 1;
+	for (int square = 0; square < 64; square++) {
+		uint64_t b = 0;
+		do {
+			CU_ASSERT_EQUAL(bishop_attacks_pre(square, b), bishop_attacks_calc(square, b));
+			b = (b - bishop_magic[square].mask) & bishop_magic[square].mask;
+		}
+		while (b);
+
+		b = 0;
+		do {
+			CU_ASSERT_EQUAL(rook_attacks_pre(square, b), rook_attacks_calc(square, b));
+			b = (b - rook_magic[square].mask) & rook_magic[square].mask;
+		}
+		while (b);
+
+		/* Squares outside of the masks should not matter. */
+		for (int i = 0; i < 1024; i++) {
+			b = xorshift64(&state) & xorshift64(&state);
+			CU_ASSERT_EQUAL(bishop_attacks_pre(square, b), bishop_attacks_calc(square, b));
+			CU_ASSERT_EQUAL(rook_attacks_pre(square, b), rook_attacks_calc(square, b));
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#include "move.h"
+#include "movegen.h"
+#include "position.h"
+
+/* Every legal move is parsed back from its standard algebraic notation, with
+ * and without the suffix for checks, and from its uci notation.
+ */
+static void move_test_san(struct position *pos, int depth) {
+	if (depth <= 0)
+		return;
+
+	move_t moves[MOVES_MAX];
+	movegen_legal(pos, moves, MOVETYPE_ALL);
+	for (move_t *move = moves; *move; move++) {
+		char str[8];
+		move_str_pgn(str, pos, move);
+		CU_ASSERT(move_compare(san_to_move(pos, str), *move));
+		size_t len = strlen(str);
+		if (str[len - 1] == '+' || str[len - 1] == '#') {
+			str[len - 1] = '\0';
+			CU_ASSERT(move_compare(san_to_move(pos, str), *move));
+		}
+		move_str_algebraic(str, move);
+		CU_ASSERT(move_compare(string_to_move(pos, str), *move));
+
+		do_move(pos, move);
+		move_test_san(pos, depth - 1);
+		undo_move(pos, move);
+	}
+}
+
+static void test_move_san(void) {
+	static const char *fens[] = {
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	};
+	struct position pos;
+	for (size_t i = 0; i < SIZE(fens); i++) {
+		pos_from_fen2(&pos, fens[i]);
+		move_test_san(&pos, 3);
+	}
+
+	/* The knight on c3 is pinned, so Ne4 is not ambiguous. */
+	pos_from_fen2(&pos, "4k3/8/8/b7/8/2N3N1/8/4K3 w - - 0 1");
+	move_t move = san_to_move(&pos, "Ne4");
+	CU_ASSERT_EQUAL(move_from(&move), g3);
+	CU_ASSERT_FALSE(san_to_move(&pos, "Nce4"));
+	CU_ASSERT_FALSE(san_to_move(&pos, "Nxe4"));
+	CU_ASSERT(san_to_move(&pos, "Nge2!?"));
+	CU_ASSERT_FALSE(san_to_move(&pos, "g3e4"));
+	CU_ASSERT(string_to_move(&pos, "g3e4"));
+
+	pos_from_fen2(&pos, "4k3/8/8/8/8/8/4K3/R6R w - - 0 1");
+	CU_ASSERT_FALSE(san_to_move(&pos, "Rd1"));
+	CU_ASSERT(san_to_move(&pos, "Rad1"));
+	CU_ASSERT_FALSE(san_to_move(&pos, "R1d1"));
+	CU_ASSERT(san_to_move(&pos, "Rhd1"));
+
+	pos_from_fen2(&pos, "4k3/8/8/8/8/8/8/R3K2R w K - 0 1");
+	CU_ASSERT(san_to_move(&pos, "O-O"));
+	CU_ASSERT_FALSE(san_to_move(&pos, "O-O-O"));
+
+	pos_from_fen2(&pos, "4k3/1P6/8/3pP3/8/8/8/4K3 w - d6 0 1");
+	move = san_to_move(&pos, "exd6");
+	CU_ASSERT_EQUAL(move_flag(&move), MOVE_EN_PASSANT);
+	CU_ASSERT_FALSE(san_to_move(&pos, "ed6"));
+	CU_ASSERT_FALSE(san_to_move(&pos, "b8"));
+	move = san_to_move(&pos, "b8=N");
+	CU_ASSERT_EQUAL(move_promote(&move), 0);
+	move = san_to_move(&pos, "b8Q+");
+	CU_ASSERT_EQUAL(move_promote(&move), 3);
+}